@@ -0,0 +1,317 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <vector>
+#include <string>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+
+#include <sys/resource.h>
+
+#include "crow.h"
+#include "indexer.h"
+#include "shard_set.h"
+#include "routes.h"
+#include "result_writer.h"
+
+using namespace std;
+
+// Builds the index of one or more index files (shards) from scratch, loads them again from the snapshots that
+// wrote, then sends every query route a set of requests derived from the index, in-process through the router,
+// and times updates of the first shard with a growing share of its files changed.
+// Progress goes to stderr, the results to stdout as one JSON object, to compare runs with each other.
+
+struct route_result
+{
+    string route;
+    size_t requests = 0;
+    size_t errors = 0; // anything but 200
+    size_t bytes = 0;
+    double seconds = 0;
+    vector<double> latencies_ms;
+};
+
+static size_t peak_rss_kilobyte()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss);
+}
+
+static double percentile(const vector<double> &sorted, double fraction)
+{
+    return sorted.empty() ? 0 : sorted[min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+}
+
+static string json(const string &s)
+{
+    string out;
+    append_json_string(out, s);
+    return out;
+}
+
+// the phases of every shard, named "<shard>: <phase>" if there are several
+static vector<phase_timing> phases_of(const shard_set &shards)
+{
+    vector<phase_timing> phases;
+    for (size_t s = 0; s < shards.size(); s++) {
+        for (const auto &phase : shards[s].phases()) {
+            phases.push_back({shards.size() > 1 ? shards[s].name_ + ": " + phase.name : phase.name, phase.seconds});
+        }
+    }
+    return phases;
+}
+
+static void print_phases(const char *name, const vector<phase_timing> &phases)
+{
+    cout << "  " << json(name) << ": [";
+    for (size_t i = 0; i < phases.size(); i++) {
+        cout << (i ? ", " : "") << "{\"phase\": " << json(phases[i].name) << ", \"seconds\": " << phases[i].seconds
+             << "}";
+    }
+    cout << "],\n";
+}
+
+struct bench_request
+{
+    string url;
+    string body;
+};
+
+// requests like index.html sends them, with terms taken from evenly spread entries of every shard
+static vector<bench_request> make_requests(const shard_versions &versions, const string &route, size_t count)
+{
+    vector<bench_request> requests;
+    for (uint32_t s = 0; s < versions.size(); s++) {
+        const auto &nodes = versions[s]->nodes;
+        const size_t until = count * (s + 1) / versions.size(); // requests after this shard's
+        const size_t step = max<size_t>(1, nodes.size() / max<size_t>(until - requests.size(), 1));
+        for (size_t id = 0; id < nodes.size() && requests.size() < until; id += step) {
+            const auto node = nodes[static_cast<node_id>(id)];
+            const string basename(node.basename());
+            if (route == "/find") {
+                requests.push_back({route, basename + "\n100"});
+            } else if (route == "/prefix") {
+                requests.push_back({route, basename.substr(0, 3) + "\n10"});
+            } else if (route == "/match") {
+                // a part of the name, like the first keystrokes of it
+                requests.push_back({route, basename.substr(basename.size() / 3, 1 + requests.size() % 6) + "\n100"});
+            } else if (route == "/dupes") {
+                requests.push_back({route, to_string(size_t(1) << (requests.size() % 12)) + "\n100"});
+            } else if (route == "/by_size" || route == "/by_date") {
+                // a page continuing at this entry's size or access time
+                requests.push_back({next_page_url(route, entry_cursor::at(node, s), result_format::html), "\n100"});
+            }
+        }
+    }
+    return requests;
+}
+
+struct update_result
+{
+    string kind;
+    double churn = 0;
+    double copy_seconds = 0;
+    double seconds = 0;
+    index_update_stats stats;
+};
+
+// A fresh listing of everything in index with every 1/churn-th file changed: for "atime" its access time,
+// for "mixed" in turns its size, its access time, left out (deleted) or listed next to a new file. Then
+// times copying the version and patching the copy with the listing, as apply_changes() does.
+static update_result run_update(const index_version &index, const string &kind, double churn)
+{
+    const auto &nodes = index.nodes;
+    node_store fresh;
+    vector<dir_id> fresh_dir(nodes.dirs().size(), no_dir);
+    const size_t step = churn > 0 ? max<size_t>(1, static_cast<size_t>(1 / churn)) : nodes.size() + 1;
+    size_t files = 0, changes = 0;
+    for (node_id id = 0; id < nodes.size(); id++) {
+        const auto node = nodes[id];
+        dir_id parent = nodes.parent_dir(id);
+        if (parent != no_dir) {
+            if (fresh_dir[parent] == no_dir) {
+                fresh_dir[parent] = fresh.dirs().intern_path(nodes.dirs().path(parent));
+            }
+            parent = fresh_dir[parent];
+        }
+        size_t kilobyte = node.kilobyte();
+        int64_t atime = node.atime();
+        if (node.filetype() == 'f' && files++ % step == step - 1) {
+            const size_t change = kind == "atime" ? 1 : changes++ % 4;
+            if (change == 2) {
+                continue;
+            }
+            if (change == 3) {
+                fresh.add(1, 0, atime, 'f', parent, "bench_inserted_" + to_string(id));
+            } else if (change == 0) {
+                kilobyte += 4;
+            } else {
+                atime = atime == no_timestamp ? 0 : atime + 1000000000;
+            }
+        }
+        fresh.add(kilobyte, node.inode(), atime, node.filetype(), parent, node.basename());
+    }
+
+    update_result result;
+    result.kind = kind;
+    result.churn = churn;
+    const auto start = chrono::steady_clock::now();
+    index_version next(index);
+    result.copy_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.stats = next.update(std::move(fresh));
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+static route_result run_route(crow::App<> &app, const string &route, const vector<bench_request> &requests,
+                              size_t threads)
+{
+    route_result result;
+    result.route = route;
+    result.latencies_ms.resize(requests.size());
+    vector<size_t> bytes(requests.size()), codes(requests.size());
+    atomic<size_t> next{0};
+    const auto start = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (size_t t = 0; t < threads; t++) {
+        clients.emplace_back([&] {
+            for (size_t i; (i = next++) < requests.size();) {
+                crow::request req;
+                req.method = "POST"_method;
+                req.raw_url = requests[i].url;
+                req.url = route;
+                req.url_params = crow::query_string(requests[i].url);
+                req.body = requests[i].body;
+                crow::response res;
+                const auto sent = chrono::steady_clock::now();
+                app.handle(req, res);
+                result.latencies_ms[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - sent).count();
+                bytes[i] = res.body.size();
+                codes[i] = res.code;
+            }
+        });
+    }
+    for (auto &client : clients) {
+        client.join();
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.requests = requests.size();
+    for (size_t i = 0; i < requests.size(); i++) {
+        result.bytes += bytes[i];
+        result.errors += codes[i] != 200;
+    }
+    sort(result.latencies_ms.begin(), result.latencies_ms.end());
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<string> filenames;
+    size_t count = 1000;
+    size_t threads = 1;
+    bool keep_snapshot = false;
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if (arg == "--requests" && i + 1 < argc) {
+            count = stoull(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = max<size_t>(1, stoull(argv[++i]));
+        } else if (arg == "--keep-snapshot") {
+            keep_snapshot = true;
+        } else {
+            filenames.push_back(arg);
+        }
+    }
+    if (filenames.empty()) {
+        cerr << "Usage " << argv[0]
+             << " [<name>=]<index>... [--requests <n per route>] [--threads <clients>] [--keep-snapshot]" << endl;
+        return 1;
+    }
+
+    // the indexer reports its progress on cout, keep cout for the results
+    auto *results = cout.rdbuf(cerr.rdbuf());
+    string index_names;
+    vector<phase_timing> build_phases;
+    {
+        shard_set build;
+        for (const auto &filename : filenames) {
+            const auto &shard = build.add_spec(filename);
+            if (!keep_snapshot) {
+                std::remove(shard.snapshot_filename_.c_str());
+            }
+            index_names += (index_names.empty() ? "" : " ") + shard.filename_;
+        }
+        build.run();
+        build_phases = phases_of(build);
+    }
+    const size_t build_peak_rss = peak_rss_kilobyte();
+    shard_set shards;
+    for (const auto &filename : filenames) {
+        shards.add_spec(filename);
+    }
+    shards.run();
+
+    query_sessions sessions(chrono::milliseconds(60 * 1000));
+    query_executor executor(max(2u, thread::hardware_concurrency()));
+    add_route_limits(executor);
+    const auto index_html = static_asset::load("index.html", "text/html; charset=utf-8");
+    crow::App<> app;
+    add_routes(app, shards, sessions, executor, index_html);
+    app.validate();
+
+    vector<route_result> routes;
+    for (const string route : {"/find", "/prefix", "/match", "/by_size", "/by_date", "/dupes"}) {
+        cerr << "benchmarking " << route << "..\n";
+        routes.push_back(run_route(app, route, make_requests(shards.current(), route, count), threads));
+    }
+    vector<update_result> updates;
+    for (const string kind : {"atime", "mixed"}) {
+        for (double churn : {0.0, 0.001, 0.01, 0.1}) {
+            cerr << "benchmarking an update with " << kind << " changes to " << churn * 100 << "% of the files..\n";
+            updates.push_back(run_update(*shards.current()[0], kind, churn));
+        }
+    }
+    cout.rdbuf(results);
+
+    cout << "{\n";
+    cout << "  \"index\": " << json(index_names) << ",\n";
+    cout << "  \"entries\": " << shards.entries(shards.current()) << ",\n";
+    print_phases("build", build_phases);
+    print_phases("load", phases_of(shards));
+    cout << "  \"threads\": " << threads << ",\n";
+    cout << "  \"routes\": [";
+    for (size_t i = 0; i < routes.size(); i++) {
+        const auto &route = routes[i];
+        cout << (i ? ",\n" : "\n") << "    {\"route\": " << json(route.route) << ", \"requests\": " << route.requests
+             << ", \"errors\": " << route.errors << ", \"bytes\": " << route.bytes
+             << ", \"requests_per_second\": " << (route.seconds > 0 ? route.requests / route.seconds : 0)
+             << ", \"p50_ms\": " << percentile(route.latencies_ms, 0.5)
+             << ", \"p90_ms\": " << percentile(route.latencies_ms, 0.9)
+             << ", \"p99_ms\": " << percentile(route.latencies_ms, 0.99)
+             << ", \"max_ms\": " << (route.latencies_ms.empty() ? 0 : route.latencies_ms.back()) << "}";
+    }
+    cout << "\n  ],\n";
+    cout << "  \"updates\": [";
+    for (size_t i = 0; i < updates.size(); i++) {
+        const auto &update = updates[i];
+        cout << (i ? ",\n" : "\n") << "    {\"kind\": " << json(update.kind) << ", \"churn\": " << update.churn
+             << ", \"modified\": " << update.stats.modified << ", \"inserted\": " << update.stats.inserted
+             << ", \"deleted\": " << update.stats.deleted << ", \"hashed\": " << update.stats.hashed
+             << ", \"copy_seconds\": " << update.copy_seconds
+             << ", \"compare_seconds\": " << update.stats.compare_seconds
+             << ", \"merge_seconds\": " << update.stats.merge_seconds
+             << ", \"hash_seconds\": " << update.stats.hash_seconds << ", \"seconds\": " << update.seconds << "}";
+    }
+    cout << "\n  ],\n";
+    cout << "  \"build_peak_rss_kilobyte\": " << build_peak_rss << ",\n";
+    cout << "  \"peak_rss_kilobyte\": " << peak_rss_kilobyte() << "\n";
+    cout << "}" << endl;
+    return 0;
+}
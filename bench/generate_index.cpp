@@ -0,0 +1,221 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include "node_store.h"
+
+using namespace std;
+
+// Writes a synthetic index file, in the format of `find -printf "%k\t%i\t%A+\t%Y\t%p\n"`, to benchmark
+// the indexer without real disks. The output only depends on the options: every directory is generated
+// from its own seed, so a duplicate subtree is simply a directory that reuses the seed of an earlier one.
+
+struct generator_options
+{
+    size_t entries = 1000000;
+    size_t depth = 6;
+    size_t fanout = 4;      // subdirectories per directory, on average
+    size_t files = 8;       // files per directory, on average
+    size_t words = 5000;    // distinct words names are made of
+    double zipf = 1.0;      // exponent of the word frequencies, 0 for uniform
+    double dupes = 0.05;    // share of directories that copy an earlier subtree
+    uint64_t seed = 1;
+    string output;          // stdout if empty
+};
+
+// splitmix64, unlike the std distributions it gives the same numbers with every standard library
+class random_source
+{
+private:
+    uint64_t state_;
+
+public:
+    explicit random_source(uint64_t seed) : state_(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    size_t below(size_t n) { return n ? static_cast<size_t>(next() % n) : 0; }
+
+    double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+class index_generator
+{
+private:
+    generator_options options_;
+    vector<string> words_;
+    vector<double> word_cdf_;
+    vector<vector<uint64_t>> subtrees_; // seeds of generated directories, by remaining depth
+    size_t written_ = 0;
+    uint64_t inode_ = 1;
+    FILE *out_;
+    string line_;
+
+    static string make_word(size_t i)
+    {
+        static const char *syllables[] = {"ka", "lo", "mi", "ne", "ru", "sa", "ti", "vo", "be", "da", "fe", "gi",
+                                          "ho", "ju", "pe", "ri", "so", "tu", "wa", "xi", "yo", "ze", "an", "el"};
+        const size_t n = sizeof(syllables) / sizeof(syllables[0]);
+        string word;
+        do {
+            word += syllables[i % n];
+            i /= n;
+        } while (i > 0);
+        return word;
+    }
+
+    const string &word(random_source &random)
+    {
+        const auto iter = upper_bound(word_cdf_.begin(), word_cdf_.end(), random.unit() * word_cdf_.back());
+        return words_[min<size_t>(iter - word_cdf_.begin(), words_.size() - 1)];
+    }
+
+    void write(uint64_t kilobyte, int64_t atime, char filetype, const string &path)
+    {
+        line_.clear();
+        line_ += to_string(kilobyte);
+        line_ += '\t';
+        line_ += to_string(inode_++);
+        line_ += '\t';
+        line_ += format_timestamp(atime);
+        line_ += '\t';
+        line_ += filetype;
+        line_ += '\t';
+        line_ += path;
+        line_ += '\n';
+        fwrite(line_.data(), 1, line_.size(), out_);
+        written_++;
+    }
+
+    static int64_t timestamp(random_source &random)
+    {
+        // somewhere between 2010 and 2020, in local wall-clock nanoseconds like parse_timestamp()
+        const int64_t start = 1262304000LL, span = 10LL * 365 * 24 * 3600;
+        return (start + static_cast<int64_t>(random.below(span))) * 1000000000LL +
+               static_cast<int64_t>(random.below(1000000000));
+    }
+
+    // contents of the directory path, generated from seed; copies of a subtree are equal up to inodes
+    void directory(const string &path, uint64_t seed, size_t depth)
+    {
+        static const char *extensions[] = {"", ".txt", ".jpg", ".pdf", ".mp3", ".cpp", ".h", ".tar.gz", ".log"};
+        random_source random(seed);
+        const size_t files = random.below(2 * options_.files + 1);
+        for (size_t i = 0; i < files && written_ < options_.entries; i++) {
+            string name = word(random);
+            if (random.below(2)) {
+                name += '_' + to_string(random.below(100));
+            }
+            name += extensions[random.below(sizeof(extensions) / sizeof(extensions[0]))];
+            // sizes spread over orders of magnitude, most files are small
+            const uint64_t kilobyte = static_cast<uint64_t>(exp2(random.unit() * random.unit() * 24));
+            write(kilobyte, timestamp(random), 'f', path + '/' + name);
+        }
+        if (depth == 0) {
+            return;
+        }
+        const size_t subdirectories = random.below(2 * options_.fanout + 1);
+        for (size_t i = 0; i < subdirectories && written_ < options_.entries; i++) {
+            const string child = path + '/' + word(random) + to_string(i);
+            auto &earlier = subtrees_[depth - 1];
+            uint64_t child_seed = random.next();
+            if (!earlier.empty() && random.unit() < options_.dupes) {
+                child_seed = earlier[random.below(earlier.size())];
+            } else if (earlier.size() < 64) {
+                earlier.push_back(child_seed);
+            } else {
+                earlier[random.below(earlier.size())] = child_seed;
+            }
+            write(4, timestamp(random), 'd', child);
+            directory(child, child_seed, depth - 1);
+        }
+    }
+
+public:
+    index_generator(const generator_options &options, FILE *out)
+        : options_(options), subtrees_(options.depth + 1), out_(out)
+    {
+        double total = 0;
+        for (size_t i = 0; i < max<size_t>(options_.words, 1); i++) {
+            words_.push_back(make_word(i));
+            total += 1.0 / pow(i + 1, options_.zipf);
+            word_cdf_.push_back(total);
+        }
+    }
+
+    // roots /mnt/root0, /mnt/root1, .. until enough entries are written
+    size_t run()
+    {
+        random_source random(options_.seed);
+        write(4, timestamp(random), 'd', "/mnt");
+        for (size_t root = 0; written_ < options_.entries; root++) {
+            const string path = "/mnt/root" + to_string(root);
+            write(4, timestamp(random), 'd', path);
+            directory(path, random.next(), options_.depth);
+        }
+        return written_;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    generator_options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const string arg = argv[i], value = argv[i + 1];
+        if (arg == "--entries") {
+            options.entries = stoull(value);
+        } else if (arg == "--depth") {
+            options.depth = stoull(value);
+        } else if (arg == "--fanout") {
+            options.fanout = stoull(value);
+        } else if (arg == "--files") {
+            options.files = stoull(value);
+        } else if (arg == "--words") {
+            options.words = stoull(value);
+        } else if (arg == "--zipf") {
+            options.zipf = stod(value);
+        } else if (arg == "--dupes") {
+            options.dupes = stod(value);
+        } else if (arg == "--seed") {
+            options.seed = stoull(value);
+        } else if (arg == "--output") {
+            options.output = value;
+        } else {
+            argc = 0;
+        }
+    }
+    if (argc % 2 == 0) {
+        cerr << "Usage " << argv[0] << " [--entries <n>] [--depth <n>] [--fanout <n>] [--files <n>] [--words <n>]"
+             << " [--zipf <exponent>] [--dupes <ratio>] [--seed <n>] [--output <index>]" << endl;
+        return 1;
+    }
+    FILE *out = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+    if (!out) {
+        cerr << "cannot write " << options.output << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    const size_t written = index_generator(options, out).run();
+    if (fclose(out) != 0) {
+        cerr << "cannot write " << options.output << endl;
+        return 1;
+    }
+    cerr << "entries: " << written << endl;
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string_view>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <stdexcept>
+
+#include "column.h"
+#include "snapshot.h"
+#include "node_store.h"
+
+// Sorted, deduplicated basenames. Entries are sorted by basename, so the posting list of a basename is
+// just a range of consecutive node ids and the dictionary only stores where every range starts.
+class basename_dictionary
+{
+private:
+    column<node_id> runs_; // first entry of every distinct basename, plus the end of the last one
+
+public:
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    void build(const node_store &nodes)
+    {
+        runs_.clear();
+        for (node_id id = 0; id < nodes.size(); id++) {
+            if (id == 0 || nodes[id].basename() != nodes[id - 1].basename()) {
+                runs_.push_back(id);
+            }
+        }
+        runs_.push_back(static_cast<node_id>(nodes.size()));
+    }
+
+    // After node_store::merge_sorted(): remaining runs start at the new id of their first kept entry, and
+    // inserted entries join the run of their basename or start one. Names are only compared next to inserted
+    // entries, a kept entry right after another kept one starts a run exactly when it did before. run_remap
+    // gets the new run of every old run (npos if all its entries were deleted), added_runs the ascending new
+    // runs that did not exist before.
+    void update(const node_store &nodes, const id_remap &remap, std::vector<size_t> &run_remap,
+                std::vector<size_t> &added_runs)
+    {
+        const auto &inserted = remap.inserted();
+        std::vector<node_id> runs;
+        std::vector<char> kept;
+        runs.reserve(size() + inserted.size() + 1);
+        run_remap.assign(size(), npos);
+        size_t run = 0, ins = 0;
+        node_id first_kept = no_node; // of run
+        auto next_kept = [&] {
+            first_kept = no_node;
+            for (; run < size() && first_kept == no_node; run++) {
+                for (node_id id = first(run); id < last(run) && first_kept == no_node; id++) {
+                    first_kept = remap(id);
+                }
+            }
+        };
+        next_kept();
+        while (first_kept != no_node || ins < inserted.size()) {
+            const bool is_inserted = first_kept == no_node || (ins < inserted.size() && inserted[ins] < first_kept);
+            const node_id id = is_inserted ? inserted[ins] : first_kept;
+            // the first kept entry of an old run starts a run, unless it follows an inserted one: then names decide
+            const bool own_run = !is_inserted && !(ins > 0 && inserted[ins - 1] + 1 == id);
+            if (runs.empty() || own_run || nodes[id].basename() != nodes[runs.back()].basename()) {
+                runs.push_back(id);
+                kept.push_back(0);
+            }
+            if (is_inserted) {
+                ins++;
+            } else {
+                kept.back() = 1;
+                run_remap[run - 1] = runs.size() - 1;
+                next_kept();
+            }
+        }
+        added_runs.clear();
+        for (size_t i = 0; i < kept.size(); i++) {
+            if (!kept[i]) {
+                added_runs.push_back(i);
+            }
+        }
+        runs.push_back(static_cast<node_id>(nodes.size()));
+        runs_.clear();
+        runs_.append(runs.begin(), runs.end());
+    }
+
+    size_t size() const { return runs_.empty() ? 0 : runs_.size() - 1; }
+    node_id first(size_t run) const { return runs_[run]; }
+    node_id last(size_t run) const { return runs_[run + 1]; }
+    std::string_view name(const node_store &nodes, size_t run) const { return nodes[runs_[run]].basename(); }
+
+    // run holding entry id
+    size_t run_of(node_id id) const
+    {
+        return static_cast<size_t>(std::upper_bound(runs_.begin(), runs_.end() - 1, id) - runs_.begin()) - 1;
+    }
+
+    // entry named name in directory parent, or no_node (entries of one run are ordered by parent directory)
+    node_id find_entry(const node_store &nodes, dir_id parent, std::string_view name) const
+    {
+        const size_t run = find(nodes, name);
+        if (run == npos) {
+            return no_node;
+        }
+        node_id first = runs_[run], count = runs_[run + 1] - runs_[run];
+        while (count > 0) {
+            const node_id half = count / 2;
+            if (nodes.parent_dir(first + half) < parent) {
+                first += half + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        return first < runs_[run + 1] && nodes.parent_dir(first) == parent ? first : no_node;
+    }
+
+    // run holding exactly this basename, or npos
+    size_t find(const node_store &nodes, std::string_view name) const
+    {
+        const size_t run = lower_bound(nodes, name);
+        return run < size() && this->name(nodes, run) == name ? run : npos;
+    }
+
+    // first run whose basename is not less than name
+    size_t lower_bound(const node_store &nodes, std::string_view name) const
+    {
+        size_t first = 0, count = size();
+        while (count > 0) {
+            const size_t half = count / 2;
+            if (this->name(nodes, first + half) < name) {
+                first += half + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        return first;
+    }
+
+    // runs [first, last> of all basenames starting with prefix
+    std::pair<size_t, size_t> prefix(const node_store &nodes, std::string_view prefix) const
+    {
+        const size_t first = lower_bound(nodes, prefix);
+        size_t last = first;
+        // galloping: type-ahead prefixes mostly match only a handful of runs
+        size_t step = 1;
+        while (last + step <= size() && name(nodes, last + step - 1).substr(0, prefix.size()) == prefix) {
+            last += step;
+            step *= 2;
+        }
+        while (step > 1) {
+            step /= 2;
+            if (last + step <= size() && name(nodes, last + step - 1).substr(0, prefix.size()) == prefix) {
+                last += step;
+            }
+        }
+        return {first, last};
+    }
+
+    size_t memory_usage() const { return runs_.heap_bytes(); }
+
+    void save(snapshot_writer &writer) const { writer.add("basenames.runs", runs_); }
+
+    void load(const snapshot_reader &reader)
+    {
+        reader.load("basenames.runs", runs_);
+        if (runs_.empty()) {
+            throw std::runtime_error("snapshot basename dictionary is empty");
+        }
+    }
+};
@@ -0,0 +1,91 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <chrono>
+#include <algorithm>
+
+// Hands items from one stage of a pipeline to the next. A full queue blocks the producers and an empty
+// one the consumers, so memory stays bounded by the capacity whichever stage is slower. The time spent
+// blocked on either side tells which one that is.
+template <typename T>
+class bounded_queue
+{
+private:
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_ = false;
+    double push_wait_seconds_ = 0;
+    double pop_wait_seconds_ = 0;
+
+public:
+    explicit bounded_queue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+    // false if the queue was closed, the item is dropped then
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (items_.size() >= capacity_ && !closed_) {
+            const auto start = std::chrono::steady_clock::now();
+            not_full_.wait(lock, [this] { return items_.size() < capacity_ || closed_; });
+            push_wait_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // the next item, or nothing once the queue is closed and drained
+    std::optional<T> pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (items_.empty() && !closed_) {
+            const auto start = std::chrono::steady_clock::now();
+            not_empty_.wait(lock, [this] { return !items_.empty() || closed_; });
+            pop_wait_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        std::optional<T> item(std::move(items_.front()));
+        items_.pop_front();
+        not_full_.notify_one();
+        return item;
+    }
+
+    // no more items: consumers get the ones still queued, further pushes fail
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    // seconds producers waited for room, summed over all of them
+    double push_wait_seconds()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return push_wait_seconds_;
+    }
+
+    // seconds consumers waited for items, summed over all of them
+    double pop_wait_seconds()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pop_wait_seconds_;
+    }
+};
@@ -0,0 +1,94 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+// Dense array that either owns its elements or refers to a mapped snapshot section. Copies share the
+// elements, owned or mapped, until one of them is written to: every non-const access first gives the
+// column elements of its own (copy-on-write), so copying an index version costs a pointer per column
+// and an update only copies the columns it changes.
+template <typename T>
+class column
+{
+private:
+    std::shared_ptr<std::vector<T>> owned_; // shared with copies of this column until it is written to
+    std::shared_ptr<const void> mapping_;
+    T *data_ = nullptr;
+    size_t size_ = 0;
+
+    void sync()
+    {
+        data_ = owned_->data();
+        size_ = owned_->size();
+    }
+
+public:
+    column() = default;
+    column(const column &other) = default;
+    column(column &&other) noexcept { swap(other); }
+    column &operator=(column other) noexcept { swap(other); return *this; }
+
+    // refers to count elements at data, which must stay valid as long as mapping is alive
+    void map(std::shared_ptr<const void> mapping, T *data, size_t count)
+    {
+        owned_.reset();
+        mapping_ = std::move(mapping);
+        data_ = data;
+        size_ = count;
+    }
+
+    // Makes the elements this column's own, before they are changed. Non-const access does this by itself,
+    // but only one thread may do it: detach before writing to a column from several threads at once.
+    void detach()
+    {
+        if (mapping_ || (owned_ && owned_.use_count() > 1)) {
+            owned_ = std::make_shared<std::vector<T>>(data_, data_ + size_);
+            mapping_.reset();
+            sync();
+        } else if (!owned_) {
+            owned_ = std::make_shared<std::vector<T>>();
+            sync();
+        }
+    }
+
+    bool mapped() const { return mapping_ != nullptr; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T *data() { detach(); return data_; }
+    const T *data() const { return data_; }
+    T &operator[](size_t i) { detach(); return data_[i]; }
+    const T &operator[](size_t i) const { return data_[i]; }
+    T *begin() { detach(); return data_; }
+    T *end() { detach(); return data_ + size_; }
+    const T *begin() const { return data_; }
+    const T *end() const { return data_ + size_; }
+    const T &back() const { return data_[size_ - 1]; }
+
+    void reserve(size_t n) { detach(); owned_->reserve(n); sync(); }
+    void resize(size_t n) { detach(); owned_->resize(n); sync(); }
+    void assign(size_t n, const T &value) { mapping_.reset(); owned_ = std::make_shared<std::vector<T>>(n, value); sync(); }
+    void clear() { mapping_.reset(); owned_ = std::make_shared<std::vector<T>>(); sync(); }
+    void push_back(const T &value) { detach(); owned_->push_back(value); sync(); }
+
+    template <typename It>
+    void append(It first, It last) { detach(); owned_->insert(owned_->end(), first, last); sync(); }
+
+    void swap(column &other) noexcept
+    {
+        owned_.swap(other.owned_);
+        mapping_.swap(other.mapping_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+    }
+
+    // bytes held on the heap, also when shared with another version; mapped sections are accounted for
+    // by the page cache instead
+    size_t heap_bytes() const { return owned_ ? owned_->capacity() * sizeof(T) : 0; }
+    size_t bytes() const { return size_ * sizeof(T); }
+};
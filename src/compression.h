@@ -0,0 +1,98 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <cctype>
+#include <cstdlib>
+
+#include <zlib.h>
+
+#include "murmur3.h"
+
+// gzip (RFC 1952) of data. Level 1 is what responses are compressed with on the fly, it gets most of the
+// gain on repetitive HTML and JSON at a fraction of the cost of the higher levels.
+inline std::string gzip(std::string_view data, int level = Z_BEST_SPEED)
+{
+    z_stream stream{};
+    // 15 bits of window, +16 for a gzip instead of a zlib header
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    const int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        throw std::runtime_error("deflate failed");
+    }
+    return out;
+}
+
+// true if an Accept-Encoding header value allows gzip, i.e. lists gzip or * without q=0
+inline bool accepts_gzip(std::string_view accept_encoding)
+{
+    while (!accept_encoding.empty()) {
+        const size_t comma = accept_encoding.find(',');
+        std::string_view coding = accept_encoding.substr(0, comma);
+        accept_encoding.remove_prefix(comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+        std::string_view params;
+        const size_t semicolon = coding.find(';');
+        if (semicolon != std::string_view::npos) {
+            params = coding.substr(semicolon + 1);
+            coding = coding.substr(0, semicolon);
+        }
+        while (!coding.empty() && std::isspace(coding.front())) {
+            coding.remove_prefix(1);
+        }
+        while (!coding.empty() && std::isspace(coding.back())) {
+            coding.remove_suffix(1);
+        }
+        if (coding != "gzip" && coding != "*") {
+            continue;
+        }
+        const size_t q = params.find("q=");
+        return q == std::string_view::npos || std::strtod(std::string(params.substr(q + 2)).c_str(), nullptr) > 0;
+    }
+    return false;
+}
+
+// A file served as is, read and compressed once. The ETag is a hash of the contents, so it changes with
+// them and clients can revalidate their copy with If-None-Match.
+struct static_asset
+{
+    std::string content_type;
+    std::string body;
+    std::string gzipped;
+    std::string etag;
+
+    // an empty asset if the file cannot be read
+    static static_asset load(const std::string &filename, std::string content_type)
+    {
+        static_asset asset;
+        asset.content_type = std::move(content_type);
+        std::ifstream file(filename, std::ios::binary);
+        asset.body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        asset.gzipped = gzip(asset.body, Z_BEST_COMPRESSION);
+        asset.etag = '"' + murmur3_128(asset.body.data(), asset.body.size()).str() + '"';
+        return asset;
+    }
+
+    // true if an If-None-Match header value names this version
+    bool matches(std::string_view if_none_match) const
+    {
+        return if_none_match == "*" || if_none_match.find(etag) != std::string_view::npos;
+    }
+};
@@ -0,0 +1,433 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "node_store.h"
+#include "murmur3.h"
+#include "thread_pool.h"
+
+// Content hashes of files, persisted between runs. Entries are keyed by inode, size and mtime, so a
+// file that changed in any of those is hashed again.
+class content_hash_cache
+{
+public:
+    struct key
+    {
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime;
+
+        bool operator==(const key &other) const
+        {
+            return inode == other.inode && size == other.size && mtime == other.mtime;
+        }
+    };
+
+    struct value
+    {
+        hash128 partial; // first and last block
+        hash128 full;
+        uint64_t has_full = 0;
+    };
+
+private:
+    struct key_hash
+    {
+        size_t operator()(const key &k) const
+        {
+            return k.inode * 0x9e3779b97f4a7c15ULL ^ k.size * 0xc2b2ae3d27d4eb4fULL ^ static_cast<uint64_t>(k.mtime);
+        }
+    };
+
+    struct header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t count;
+    };
+
+    struct record
+    {
+        key k;
+        value v;
+    };
+
+    // bump whenever the record layout or the way hashes are computed changes
+    static constexpr uint32_t version = 1;
+    static constexpr char magic[8] = {'I', 'D', 'X', 'H', 'A', 'S', 'H', '\0'};
+
+    std::string filename_;
+    std::unordered_map<key, value, key_hash> entries_;
+    mutable std::mutex mutex_;
+    bool dirty_ = false;
+
+public:
+    explicit content_hash_cache(std::string filename) : filename_(std::move(filename)) {}
+
+    // a missing or unusable cache file is not an error, it just means everything gets hashed
+    size_t load()
+    {
+        std::ifstream in(filename_, std::ios::binary);
+        header h{};
+        if (!in.read(reinterpret_cast<char *>(&h), sizeof(h)) || memcmp(h.magic, magic, sizeof(magic)) != 0 ||
+            h.version != version) {
+            return 0;
+        }
+        std::vector<record> records(h.count);
+        if (!in.read(reinterpret_cast<char *>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(record)))) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.reserve(records.size());
+        for (const auto &r : records) {
+            entries_[r.k] = r.v;
+        }
+        return entries_.size();
+    }
+
+    void save()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!dirty_) {
+            return;
+        }
+        const std::string tmp = filename_ + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        header h{};
+        memcpy(h.magic, magic, sizeof(magic));
+        h.version = version;
+        h.count = entries_.size();
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        for (const auto &entry : entries_) {
+            const record r{entry.first, entry.second};
+            out.write(reinterpret_cast<const char *>(&r), sizeof(r));
+        }
+        out.close();
+        if (!out || std::rename(tmp.c_str(), filename_.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("cannot write " + filename_);
+        }
+        dirty_ = false;
+    }
+
+    bool find(const key &k, value &v) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(k);
+        if (it == entries_.end()) {
+            return false;
+        }
+        v = it->second;
+        return true;
+    }
+
+    void store(const key &k, const value &v)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[k] = v;
+        dirty_ = true;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    // drops the entries of files whose inode is not in inodes (sorted), they are no longer indexed
+    size_t retain(const std::vector<uint64_t> &inodes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t dropped = 0;
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (std::binary_search(inodes.begin(), inodes.end(), it->first.inode)) {
+                ++it;
+            } else {
+                it = entries_.erase(it);
+                dropped++;
+            }
+        }
+        dirty_ = dirty_ || dropped > 0;
+        return dropped;
+    }
+};
+
+struct content_stage_stats
+{
+    const char *name;
+    size_t files_in;
+    size_t files_out;
+    uint64_t bytes_read;
+    double seconds;
+};
+
+// Finds regular files with identical content. Each stage only passes on files that still have a partner
+// with the same key, so most files are never opened:
+//   1. exact size according to stat(), not the kilobytes in the index: those are disk usage, which
+//      differs for equal content in sparse, compressed or inlined files
+//   2. hash of the first and last block
+//   3. hash of the full content, only needed for files larger than two blocks
+// Empty files are left out, they are all equal.
+// Reads are done with large preads on a dedicated pool of io_threads, so many requests are in flight at
+// once on disks and network mounts that can serve them in parallel.
+class content_dupes
+{
+public:
+    struct group
+    {
+        uint64_t size;
+        hash128 hash;
+        std::vector<node_id> members;
+    };
+
+private:
+    static constexpr size_t partial_block = 64 * 1024;
+    static constexpr size_t read_block = 1024 * 1024;
+
+    struct file
+    {
+        node_id id;
+        uint64_t size;
+        content_hash_cache::key key;
+        hash128 hash;
+    };
+
+    content_hash_cache cache_;
+    size_t io_threads_;
+    std::shared_ptr<const std::vector<group>> groups_;
+    mutable std::mutex mutex_;
+    std::atomic<int> stage_{0};
+    std::atomic<size_t> processed_{0};
+    std::atomic<size_t> total_{0};
+    std::atomic<uint64_t> bytes_read_{0};
+
+    // keeps only files sharing (size, hash) with another file, ordered by that key
+    static void keep_duplicates(std::vector<file> &files)
+    {
+        auto less = [](const file &lhs, const file &rhs) {
+            if (lhs.size != rhs.size) {
+                return lhs.size > rhs.size;
+            }
+            return lhs.hash != rhs.hash ? lhs.hash < rhs.hash : lhs.id < rhs.id;
+        };
+        auto same = [](const file &lhs, const file &rhs) { return lhs.size == rhs.size && lhs.hash == rhs.hash; };
+        std::sort(files.begin(), files.end(), less);
+        size_t out = 0;
+        for (size_t first = 0, last; first < files.size(); first = last) {
+            last = first + 1;
+            while (last < files.size() && same(files[first], files[last])) {
+                last++;
+            }
+            if (last - first > 1) {
+                out = static_cast<size_t>(std::move(files.begin() + first, files.begin() + last, files.begin() + out) - files.begin());
+            }
+        }
+        files.resize(out);
+    }
+
+    bool read_exactly(int fd, char *buffer, size_t size, uint64_t offset)
+    {
+        while (size > 0) {
+            const ssize_t n = ::pread(fd, buffer, size, static_cast<off_t>(offset));
+            if (n <= 0) {
+                return false;
+            }
+            bytes_read_ += static_cast<uint64_t>(n);
+            buffer += n;
+            size -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    // hash of the first and last partial_block bytes, or of the whole content if full is set
+    bool hash_content(const std::string &path, uint64_t size, bool full, hash128 &out, std::vector<char> &buffer)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+        if (fd == -1 && errno == EPERM) {
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); // O_NOATIME is only allowed for our own files
+        }
+        if (fd == -1) {
+            return false;
+        }
+        ::posix_fadvise(fd, 0, 0, full ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+        hash128 hash;
+        bool ok = true;
+        auto update = [&](uint64_t offset, size_t length) {
+            buffer.resize(std::max(buffer.size(), length));
+            ok = ok && read_exactly(fd, buffer.data(), length, offset);
+            hash = murmur3_128(buffer.data(), length, hash.low ^ hash.high);
+        };
+        if (full) {
+            for (uint64_t offset = 0; offset < size && ok; offset += read_block) {
+                update(offset, static_cast<size_t>(std::min<uint64_t>(read_block, size - offset)));
+            }
+        } else {
+            update(0, static_cast<size_t>(std::min<uint64_t>(partial_block, size)));
+            if (size > partial_block) {
+                const uint64_t tail = std::max<uint64_t>(partial_block, size - partial_block);
+                update(tail, static_cast<size_t>(size - tail));
+            }
+        }
+        ::close(fd);
+        out = hash;
+        return ok;
+    }
+
+    // runs f on every file on the io pool, drops the files for which it returns false
+    template <typename F>
+    void for_each_file(thread_pool &pool, std::vector<file> &files, F f)
+    {
+        processed_ = 0;
+        total_ = files.size();
+        std::vector<char> keep(files.size(), 0);
+        parallel_for(pool, files.size(), [&](size_t i) {
+            static thread_local std::vector<char> buffer;
+            keep[i] = f(files[i], buffer) ? 1 : 0;
+            processed_++;
+        });
+        size_t out = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            if (keep[i]) {
+                files[out++] = files[i];
+            }
+        }
+        files.resize(out);
+    }
+
+public:
+    explicit content_dupes(std::string cache_filename, size_t io_threads = 16)
+        : cache_(std::move(cache_filename)), io_threads_(io_threads) {}
+
+    std::vector<content_stage_stats> find(const node_store &nodes)
+    {
+        std::vector<content_stage_stats> stats;
+        auto start = std::chrono::steady_clock::now();
+        auto stage_done = [&](const char *name, size_t files_in, size_t files_out) {
+            const auto now = std::chrono::steady_clock::now();
+            stats.push_back({name, files_in, files_out, bytes_read_.exchange(0),
+                             std::chrono::duration<double>(now - start).count()});
+            start = now;
+            stage_++;
+        };
+        stage_ = 1;
+        cache_.load();
+        thread_pool pool(io_threads_);
+
+        std::vector<file> files;
+        std::vector<uint64_t> inodes;
+        for (const auto &node : nodes) {
+            if (node.filetype() == 'f') {
+                files.push_back({node.id(), 0, {}, {}});
+                inodes.push_back(node.inode());
+            }
+        }
+        std::sort(inodes.begin(), inodes.end());
+        cache_.retain(inodes);
+
+        size_t files_in = files.size();
+        for_each_file(pool, files, [&nodes](file &f, std::vector<char> &) {
+            struct stat st{};
+            if (::stat(nodes[f.id].file().c_str(), &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+                return false;
+            }
+            f.size = static_cast<uint64_t>(st.st_size);
+            f.key = {static_cast<uint64_t>(st.st_ino), f.size,
+                     static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec};
+            return true;
+        });
+        keep_duplicates(files);
+        stage_done("exact size", files_in, files.size());
+
+        files_in = files.size();
+        for_each_file(pool, files, [&](file &f, std::vector<char> &buffer) {
+            content_hash_cache::value cached;
+            if (cache_.find(f.key, cached)) {
+                f.hash = cached.partial;
+                return true;
+            }
+            if (!hash_content(nodes[f.id].file(), f.size, false, f.hash, buffer)) {
+                return false;
+            }
+            cache_.store(f.key, {f.hash, {}, 0});
+            return true;
+        });
+        keep_duplicates(files);
+        stage_done("first and last block", files_in, files.size());
+
+        files_in = files.size();
+        for_each_file(pool, files, [&](file &f, std::vector<char> &buffer) {
+            if (f.size <= 2 * partial_block) {
+                return true; // the first and last block already covered everything
+            }
+            content_hash_cache::value cached;
+            if (cache_.find(f.key, cached) && cached.has_full) {
+                f.hash = cached.full;
+                return true;
+            }
+            const hash128 partial = f.hash;
+            if (!hash_content(nodes[f.id].file(), f.size, true, f.hash, buffer)) {
+                return false;
+            }
+            cache_.store(f.key, {partial, f.hash, 1});
+            return true;
+        });
+        keep_duplicates(files);
+        stage_done("full content", files_in, files.size());
+
+        auto result = std::make_shared<std::vector<group>>();
+        for (const auto &f : files) {
+            if (result->empty() || result->back().size != f.size || result->back().hash != f.hash) {
+                result->push_back({f.size, f.hash, {}});
+            }
+            result->back().members.push_back(f.id);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            groups_ = std::move(result);
+        }
+        cache_.save();
+        return stats;
+    }
+
+    // null until find() completed, groups are ordered by file size, largest first
+    std::shared_ptr<const std::vector<group>> groups() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return groups_;
+    }
+
+    std::string status() const
+    {
+        static const char *stages[] = {"not started", "comparing exact sizes", "hashing first and last blocks",
+                                       "hashing full content", "done"};
+        const int stage = std::min(stage_.load(), 4);
+        std::string result = stages[stage];
+        if (stage >= 1 && stage <= 3) {
+            result += ": " + std::to_string(processed_.load()) + " of " + std::to_string(total_.load()) + " files";
+        }
+        return result;
+    }
+
+    size_t cached_hashes() const { return cache_.size(); }
+};
@@ -0,0 +1,674 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <vector>
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "coordinator.h"
+#include "routes.h"
+#include "result_writer.h"
+#include "metrics.h"
+
+using namespace std;
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+peer peer::parse(const string &endpoint)
+{
+    const size_t colon = endpoint.rfind(':');
+    peer p{endpoint.substr(0, colon), colon == string::npos ? "8888" : endpoint.substr(colon + 1)};
+    if (p.host.empty() || p.port.empty() || p.port.find_first_not_of("0123456789") != string::npos) {
+        throw std::invalid_argument("not a peer: " + endpoint);
+    }
+    return p;
+}
+
+// One request to one peer: resolve, connect, write and read, each step started by the one before on the
+// io_context of ask_peers(). Steps still pending when it stops waiting are dropped with the io_context.
+struct peer_call : std::enable_shared_from_this<peer_call>
+{
+    tcp::resolver resolver;
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer;
+    http::request<http::string_body> request;
+    http::response<http::string_body> response;
+    peer_response &result;
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    peer_call(asio::io_context &io, peer_response &result) : resolver(io), stream(io), result(result) {}
+
+    void done(const string &error)
+    {
+        result.error = error;
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    void run(const peer &p)
+    {
+        auto self = shared_from_this();
+        resolver.async_resolve(p.host, p.port, [self](beast::error_code ec, tcp::resolver::results_type endpoints) {
+            if (ec) {
+                return self->done("resolve: " + ec.message());
+            }
+            self->stream.async_connect(endpoints, [self](beast::error_code ec, const tcp::endpoint &) {
+                if (ec) {
+                    return self->done("connect: " + ec.message());
+                }
+                http::async_write(self->stream, self->request, [self](beast::error_code ec, size_t) {
+                    if (ec) {
+                        return self->done("write: " + ec.message());
+                    }
+                    http::async_read(self->stream, self->buffer, self->response, [self](beast::error_code ec, size_t) {
+                        if (ec) {
+                            return self->done("read: " + ec.message());
+                        }
+                        self->result.status = static_cast<int>(self->response.result_int());
+                        self->result.body = std::move(self->response.body());
+                        self->result.ok = self->result.status == 200;
+                        self->done(self->result.ok ? "" : "status " + to_string(self->result.status));
+                        self->stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+                    });
+                });
+            });
+        });
+    }
+};
+
+vector<peer_response> ask_peers(const vector<peer> &peers, const string &target, const string &body,
+                                chrono::milliseconds timeout)
+{
+    return ask_peers(peers, vector<string>(peers.size(), target), vector<string>(peers.size(), body), timeout);
+}
+
+vector<peer_response> ask_peers(const vector<peer> &peers, const vector<string> &targets, const vector<string> &bodies,
+                                chrono::milliseconds timeout)
+{
+    vector<peer_response> responses(peers.size());
+    asio::io_context io;
+    for (size_t i = 0; i < peers.size(); i++) {
+        if (targets[i].empty()) {
+            continue;
+        }
+        responses[i].error = "no answer within " + to_string(timeout.count()) + " ms";
+        responses[i].seconds = timeout.count() / 1000.0;
+        auto call = make_shared<peer_call>(io, responses[i]);
+        call->request = {http::verb::post, targets[i], 11};
+        call->request.set(http::field::host, peers[i].host);
+        call->request.set(http::field::connection, "close");
+        call->request.body() = bodies[i];
+        call->request.prepare_payload();
+        call->run(peers[i]);
+    }
+    io.run_for(timeout);
+    return responses;
+}
+
+namespace {
+
+// the entries /find, /match, /by_size and /by_date list, as peers send them in JSON
+struct peer_row
+{
+    char filetype;
+    string file;
+    uint64_t kilobyte;
+    string date;
+
+    string_view basename() const { return string_view(file).substr(file.find_last_of('/') + 1); }
+
+    bool operator==(const peer_row &other) const
+    {
+        return file == other.file && kilobyte == other.kilobyte && date == other.date && filetype == other.filetype;
+    }
+};
+
+// the order of the listing, entries by basename and then by path for ties between peers
+enum class row_order { entry, size, date };
+
+bool row_less(row_order order, const peer_row &lhs, const peer_row &rhs)
+{
+    if (order == row_order::size && lhs.kilobyte != rhs.kilobyte) {
+        return lhs.kilobyte > rhs.kilobyte;
+    }
+    if (order == row_order::date && lhs.date != rhs.date) {
+        return lhs.date > rhs.date; // the format sorts like the time, entries without a date last
+    }
+    const int by_name = lhs.basename().compare(rhs.basename());
+    if (by_name != 0) {
+        return by_name < 0;
+    }
+    if (lhs.file != rhs.file) {
+        return lhs.file < rhs.file;
+    }
+    if (lhs.kilobyte != rhs.kilobyte) {
+        return lhs.kilobyte < rhs.kilobyte;
+    }
+    return lhs.date != rhs.date ? lhs.date < rhs.date : lhs.filetype < rhs.filetype;
+}
+
+// the parameters of req other than format and position, each starting with '&'
+string query_params(const crow::request &req)
+{
+    string params;
+    const size_t query = req.raw_url.find('?');
+    if (query != string::npos) {
+        vector<string> parts;
+        boost::split(parts, req.raw_url.substr(query + 1), boost::is_any_of("&"));
+        for (const auto &param : parts) {
+            const string name = param.substr(0, param.find('='));
+            if (!param.empty() && name != "format" && name != "cursor" && name != "offset") {
+                params += '&' + param;
+            }
+        }
+    }
+    return params;
+}
+
+// route with the parameters of req, as JSON, for the first page: add the position on the peer
+string peer_target(const char *route, const crow::request &req)
+{
+    return string(route) + "?format=json" + query_params(req);
+}
+
+// a duplicate directory group of /dupes, by hash over all peers
+struct peer_group
+{
+    string hash;
+    uint64_t kilobyte = 0;
+    vector<pair<string, uint64_t>> members; // file and number of files below it
+};
+
+// the order of /dupes on peers and here: largest first, then by hash
+bool group_less(const peer_group &lhs, const peer_group &rhs)
+{
+    return lhs.kilobyte != rhs.kilobyte ? lhs.kilobyte > rhs.kilobyte : lhs.hash < rhs.hash;
+}
+
+// Where the part of a peer on the next page starts: skip rows into its page at cursor (its own, URL
+// encoded, empty for its first page), or for /dupes skip groups into its listing. Nowhere once done.
+struct peer_position
+{
+    bool done = false;
+    size_t skip = 0;
+    string cursor;
+};
+
+// ?cursor= of the coordinator: "<skip>:<cursor>" or "-" for every peer, separated by commas; none is the
+// start of the listing. Throws std::invalid_argument for anything else.
+vector<peer_position> parse_positions(const char *param, size_t peers)
+{
+    vector<peer_position> positions(peers);
+    if (!param || !*param) {
+        return positions;
+    }
+    vector<string> parts;
+    boost::split(parts, string(param), boost::is_any_of(","));
+    if (parts.size() != peers) {
+        throw std::invalid_argument("cursor is not one of this coordinator");
+    }
+    for (size_t i = 0; i < peers; i++) {
+        const size_t colon = parts[i].find(':');
+        if (parts[i] == "-") {
+            positions[i].done = true;
+        } else if (colon == string::npos || colon == 0 ||
+                   parts[i].find_first_not_of("0123456789") < colon) {
+            throw std::invalid_argument("cursor is not one of this coordinator");
+        } else {
+            positions[i].skip = std::stoull(parts[i].substr(0, colon));
+            positions[i].cursor = parts[i].substr(colon + 1);
+        }
+    }
+    return positions;
+}
+
+// the page after this one, or "" if every peer is done
+string next_page(const char *route, const crow::request &req, const vector<peer_position> &positions,
+                 result_format format)
+{
+    string cursor;
+    bool done = true;
+    for (const auto &position : positions) {
+        cursor += cursor.empty() ? "" : ",";
+        cursor += position.done ? "-" : to_string(position.skip) + ":" + position.cursor;
+        done = done && position.done;
+    }
+    if (done) {
+        return "";
+    }
+    string url = string(route) + "?cursor=";
+    append_url_encoded(url, cursor);
+    url += query_params(req);
+    return format == result_format::json ? url + "&format=json" : url;
+}
+
+// the cursor in a next link of a peer, as it is in there (URL encoded); empty if there is none
+string cursor_of(const string &next_url)
+{
+    const size_t start = next_url.find("cursor=");
+    if (start == string::npos) {
+        return "";
+    }
+    const size_t end = next_url.find('&', start);
+    return next_url.substr(start + 7, end == string::npos ? string::npos : end - start - 7);
+}
+
+boost::property_tree::ptree parse_json(const string &body)
+{
+    istringstream in(body);
+    boost::property_tree::ptree tree;
+    boost::property_tree::read_json(in, tree);
+    return tree;
+}
+
+// what the coordinator records of every peer in default_metrics()
+struct peer_metrics
+{
+    counter &requests;
+    counter &failures; // no answer in time, or not a usable one
+    histogram &latency;
+
+    explicit peer_metrics(const peer &p)
+        : requests(default_metrics().add_counter("indexer_peer_requests_total", "Requests sent to a peer",
+                                                 metric_label("peer", p.name()))),
+          failures(default_metrics().add_counter("indexer_peer_failures_total",
+                                                 "Requests to a peer that got no usable answer in time",
+                                                 metric_label("peer", p.name()))),
+          latency(default_metrics().add_histogram("indexer_peer_request_duration_seconds",
+                                                  "Seconds until a peer answered, or was given up on", 1e-6, 26,
+                                                  metric_label("peer", p.name())))
+    {}
+};
+
+} // namespace
+
+void add_coordinator_routes(crow::App<> &app, const vector<peer> &peers, chrono::milliseconds timeout,
+                            const static_asset &index_html)
+{
+    auto metrics = make_shared<vector<unique_ptr<peer_metrics>>>();
+    for (const auto &p : peers) {
+        metrics->emplace_back(new peer_metrics(p));
+    }
+
+    // Asks the peers that have a target, each with its own target and body, and calls parse(peer, body)
+    // for every answer, answers it cannot parse count as missing. Returns the peers whose part is missing,
+    // or an error response if all of the asked ones are.
+    auto ask_each = [&peers, timeout, metrics](const vector<string> &targets, const vector<string> &bodies,
+                                              vector<string> &unanswered, auto parse) -> optional<crow::response> {
+        const auto responses = ask_peers(peers, targets, bodies, timeout);
+        size_t asked = 0, superseded = 0;
+        for (size_t i = 0; i < peers.size(); i++) {
+            if (targets[i].empty()) {
+                continue;
+            }
+            asked++;
+            auto &peer_metric = *(*metrics)[i];
+            peer_metric.requests.add();
+            peer_metric.latency.observe(static_cast<uint64_t>(responses[i].seconds * 1e6));
+            string error = responses[i].error;
+            if (responses[i].ok) {
+                try {
+                    parse(i, responses[i].body);
+                } catch (const std::exception &e) {
+                    error = string("unreadable answer: ") + e.what();
+                }
+            }
+            if (!error.empty()) {
+                peer_metric.failures.add();
+                unanswered.push_back(peers[i].name() + " (" + error + ")");
+                superseded += responses[i].status == 409;
+            }
+        }
+        if (unanswered.size() < asked || asked == 0) {
+            return nullopt;
+        }
+        if (superseded > 0) {
+            return crow::response(409, "superseded by a newer query of the session\n");
+        }
+        string message = "no peer answered:\n";
+        for (const auto &peer : unanswered) {
+            message += "  " + peer + "\n";
+        }
+        return crow::response(502, message);
+    };
+
+    // ask_each() with the target of route and the body of req for every peer
+    auto ask = [&peers, ask_each](const char *route, const crow::request &req, vector<string> &unanswered,
+                                  auto parse) {
+        return ask_each(vector<string>(peers.size(), peer_target(route, req)), vector<string>(peers.size(), req.body),
+                        unanswered, parse);
+    };
+
+    // parameters a route cannot parse are answered with 400, like the routes of an indexer do
+    auto checked = [](auto handler) {
+        return [handler](const crow::request &req) {
+            try {
+                return handler(req);
+            } catch (const std::logic_error &e) {
+                return crow::response(400, string(e.what()) + "\n");
+            }
+        };
+    };
+
+    // /find, /match, /by_size and /by_date: a page of every peer, merged in the order of the listing, the
+    // same entry reported by several peers (a shared mount) only once on a page. Rows of a peer stay in the
+    // order it sent them, the one it continues in, which within a basename is by directory on the peer and
+    // not by path. So the next row is the least of the next rows of all peers, and the page ends early
+    // where a peer that has more rows has none left here: its next one is not known yet (as in
+    // merge_hits()).
+    auto listing = [&peers, ask_each, checked](const char *route, row_order order) {
+        return checked([&peers, ask_each, route, order](const crow::request &req) {
+            vector<string> body;
+            boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+            const size_t limit = body.size() > 1 && !body[1].empty() ? std::stoull(body[1]) : 100;
+            const auto format = result_format_of(req.url_params.get("format"));
+            auto positions = parse_positions(req.url_params.get("cursor"), peers.size());
+            vector<string> targets(peers.size()), bodies(peers.size());
+            for (size_t i = 0; i < peers.size(); i++) {
+                if (!positions[i].done) {
+                    targets[i] = peer_target(route, req) +
+                                 (positions[i].cursor.empty() ? "" : "&cursor=" + positions[i].cursor);
+                    bodies[i] = (body.empty() ? "" : body[0]) + "\n" + to_string(limit);
+                }
+            }
+            // the rows of every peer after the ones shown before, and the cursor after them if it has more
+            vector<vector<peer_row>> rows(peers.size());
+            vector<string> more(peers.size());
+            vector<char> answered(peers.size(), 0);
+            vector<string> unanswered;
+            auto error = ask_each(targets, bodies, unanswered, [&](size_t i, const string &answer) {
+                const auto tree = parse_json(answer);
+                vector<peer_row> parsed;
+                for (const auto &row : tree.get_child("results")) {
+                    const auto type = row.second.get<string>("type", "");
+                    parsed.push_back({type.empty() ? '?' : type[0], row.second.get<string>("file"),
+                                      row.second.get<uint64_t>("kilobyte", 0), row.second.get<string>("date", "")});
+                }
+                parsed.erase(parsed.begin(), parsed.begin() + std::min(parsed.size(), positions[i].skip));
+                rows[i] = std::move(parsed);
+                more[i] = cursor_of(tree.get<string>("next", ""));
+                answered[i] = 1;
+            });
+            if (error) {
+                return std::move(*error);
+            }
+
+            vector<peer_row> page;
+            vector<size_t> taken(peers.size(), 0);
+            auto skip_shown = [&](size_t i) {
+                while (taken[i] < rows[i].size() && std::find(page.begin(), page.end(), rows[i][taken[i]]) != page.end()) {
+                    taken[i]++;
+                }
+            };
+            while (page.size() < limit) {
+                size_t best = peers.size();
+                bool unknown = false;
+                for (size_t i = 0; i < peers.size(); i++) {
+                    skip_shown(i);
+                    if (taken[i] < rows[i].size()) {
+                        if (best == peers.size() || row_less(order, rows[i][taken[i]], rows[best][taken[best]])) {
+                            best = i;
+                        }
+                    } else if (!more[i].empty()) {
+                        unknown = true;
+                    }
+                }
+                if (unknown || best == peers.size()) {
+                    break;
+                }
+                page.push_back(rows[best][taken[best]++]);
+            }
+            // peers continue after their rows on this page, the ones that did not answer where they were
+            for (size_t i = 0; i < peers.size(); i++) {
+                if (!answered[i]) {
+                    continue;
+                }
+                skip_shown(i);
+                if (taken[i] < rows[i].size()) {
+                    positions[i].skip += taken[i];
+                } else if (!more[i].empty()) {
+                    positions[i] = {false, 0, more[i]};
+                } else {
+                    positions[i].done = true;
+                }
+            }
+            const string next = next_page(route, req, positions, format);
+
+            crow::response res;
+            if (order == row_order::size && format == result_format::html) {
+                for (const auto &row : page) {
+                    res.body += "match: " + to_string(row.kilobyte / 1024) + "MiB " + row.file + "\n";
+                }
+                if (!next.empty()) {
+                    res.body += "<a class=\"next_page\" href=\"";
+                    append_html_escaped(res.body, next);
+                    res.body += "\">next page</a>\n";
+                }
+                for (const auto &peer : unanswered) {
+                    res.body += "no answer from " + peer + "\n";
+                }
+            } else {
+                result_writer results(res.body, format);
+                for (const auto &row : page) {
+                    results.write(row.filetype, row.file, row.kilobyte, row.date);
+                }
+                results.finish(next, unanswered);
+            }
+            if (format == result_format::json) {
+                res.set_header("Content-Type", "application/json");
+            }
+            compress_response(req, res);
+            return res;
+        });
+    };
+
+    CROW_ROUTE(app, "/")
+    ([&](const crow::request &req) {
+        return asset_response(req, index_html);
+    });
+
+    CROW_ROUTE(app, "/status")
+    ([&peers, metrics]{
+        ostringstream ss;
+        for (size_t i = 0; i < peers.size(); i++) {
+            const auto &peer_metric = *(*metrics)[i];
+            ss << "peer " << peers[i].name() << ": requests " << peer_metric.requests.value() << ", failed "
+               << peer_metric.failures.value() << endl;
+        }
+        return crow::response{ss.str()};
+    });
+
+    CROW_ROUTE(app, "/metrics")
+    ([]{
+        crow::response res(default_metrics().render());
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
+    });
+
+    CROW_ROUTE(app, "/find").methods("POST"_method)(listing("/find", row_order::entry));
+    CROW_ROUTE(app, "/match").methods("POST"_method)(listing("/match", row_order::entry));
+    CROW_ROUTE(app, "/by_size").methods("POST"_method)(listing("/by_size", row_order::size));
+    CROW_ROUTE(app, "/by_date").methods("POST"_method)(listing("/by_date", row_order::date));
+
+    // the distinct basenames of all peers, counted over all of them
+    CROW_ROUTE(app, "/prefix")
+        .methods("POST"_method)
+    (checked([ask](const crow::request &req) {
+        vector<string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        const size_t limit = body.size() > 1 && !body[1].empty() ? std::stoull(body[1]) : 10;
+        map<string, uint64_t> counts;
+        vector<string> unanswered;
+        auto error = ask("/prefix", req, unanswered, [&](size_t, const string &answer) {
+            istringstream lines(answer);
+            for (string line; getline(lines, line);) {
+                const size_t tab = line.find('\t');
+                if (tab != string::npos) {
+                    counts[line.substr(0, tab)] += std::stoull(line.substr(tab + 1));
+                }
+            }
+        });
+        if (error) {
+            return std::move(*error);
+        }
+        ostringstream ss;
+        size_t rows = 0;
+        for (auto iter = counts.begin(); iter != counts.end() && rows < limit; ++iter, rows++) {
+            ss << iter->first << '\t' << iter->second << endl;
+        }
+        crow::response res{ss.str()};
+        // the lines are completions, the peers they are missing from go in a header
+        if (!unanswered.empty()) {
+            res.set_header("X-Unanswered-Peers", boost::algorithm::join(unanswered, ", "));
+        }
+        return res;
+    }));
+
+    // duplicate directory groups of all peers, a group with the same hash on several of them is one. Peers
+    // list them in the order of group_less() too, pages are merged like the listings and every peer
+    // continues at the number of its groups shown.
+    CROW_ROUTE(app, "/dupes")
+        .methods("POST"_method)
+    (checked([&peers, ask_each](const crow::request &req) {
+        vector<string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        const size_t limit = body.size() > 1 && !body[1].empty() ? std::stoull(body[1]) : 100;
+        const auto format = result_format_of(req.url_params.get("format"));
+        auto positions = parse_positions(req.url_params.get("cursor"), peers.size());
+        vector<string> targets(peers.size()), bodies(peers.size());
+        for (size_t i = 0; i < peers.size(); i++) {
+            if (!positions[i].done) {
+                targets[i] = peer_target("/dupes", req) +
+                             (positions[i].skip > 0 ? "&offset=" + to_string(positions[i].skip) : "");
+                bodies[i] = (body.empty() ? "" : body[0]) + "\n" + to_string(limit);
+            }
+        }
+        vector<vector<peer_group>> of_peer(peers.size());
+        vector<char> answered(peers.size(), 0), more(peers.size(), 0);
+        vector<string> unanswered;
+        auto error = ask_each(targets, bodies, unanswered, [&](size_t i, const string &answer) {
+            const auto tree = parse_json(answer);
+            vector<peer_group> parsed;
+            for (const auto &g : tree.get_child("groups")) {
+                peer_group group{g.second.get<string>("hash"), g.second.get<uint64_t>("kilobyte"), {}};
+                for (const auto &m : g.second.get_child("members")) {
+                    group.members.emplace_back(m.second.get<string>("file"), m.second.get<uint64_t>("files", 0));
+                }
+                parsed.push_back(std::move(group));
+            }
+            of_peer[i] = std::move(parsed);
+            const string next = tree.get<string>("next", "");
+            more[i] = !next.empty() && next != "null";
+            answered[i] = 1;
+        });
+        if (error) {
+            return std::move(*error);
+        }
+
+        vector<peer_group> groups;
+        vector<size_t> taken(peers.size(), 0);
+        while (groups.size() < limit) {
+            size_t best = peers.size();
+            bool unknown = false;
+            for (size_t i = 0; i < peers.size(); i++) {
+                if (taken[i] < of_peer[i].size()) {
+                    if (best == peers.size() || group_less(of_peer[i][taken[i]], of_peer[best][taken[best]])) {
+                        best = i;
+                    }
+                } else if (more[i]) {
+                    unknown = true;
+                }
+            }
+            if (unknown || best == peers.size()) {
+                break;
+            }
+            peer_group group{of_peer[best][taken[best]].hash, of_peer[best][taken[best]].kilobyte, {}};
+            for (size_t i = 0; i < peers.size(); i++) {
+                if (taken[i] < of_peer[i].size() && of_peer[i][taken[i]].hash == group.hash) {
+                    for (auto &member : of_peer[i][taken[i]].members) {
+                        if (std::find(group.members.begin(), group.members.end(), member) == group.members.end()) {
+                            group.members.push_back(std::move(member));
+                        }
+                    }
+                    taken[i]++;
+                }
+            }
+            groups.push_back(std::move(group));
+        }
+        for (size_t i = 0; i < peers.size(); i++) {
+            if (answered[i]) {
+                positions[i].skip += taken[i];
+                positions[i].done = taken[i] == of_peer[i].size() && !more[i];
+            }
+        }
+        const string next = next_page("/dupes", req, positions, format);
+
+        crow::response res;
+        if (format == result_format::json) {
+            res.body = "{\"groups\":[";
+            for (size_t i = 0; i < groups.size(); i++) {
+                res.body += i ? ",\n{\"hash\":\"" : "\n{\"hash\":\"";
+                res.body += groups[i].hash + "\",\"kilobyte\":" + to_string(groups[i].kilobyte) + ",\"members\":[";
+                for (size_t m = 0; m < groups[i].members.size(); m++) {
+                    res.body += m ? ",{\"file\":" : "{\"file\":";
+                    append_json_string(res.body, groups[i].members[m].first);
+                    res.body += ",\"files\":" + to_string(groups[i].members[m].second) + "}";
+                }
+                res.body += "]}";
+            }
+            res.body += "],\n\"next\":";
+            if (next.empty()) {
+                res.body += "null";
+            } else {
+                append_json_string(res.body, next);
+            }
+            if (!unanswered.empty()) {
+                res.body += ",\"unanswered\":[";
+                for (size_t i = 0; i < unanswered.size(); i++) {
+                    res.body += i ? "," : "";
+                    append_json_string(res.body, unanswered[i]);
+                }
+                res.body += "]";
+            }
+            res.body += "}\n";
+            res.set_header("Content-Type", "application/json");
+        } else {
+            ostringstream ss;
+            for (const auto &group : groups) {
+                ss << "hash " << group.hash << " occurs " << group.members.size() << " times..." << endl;
+                for (const auto &member : group.members) {
+                    ss << "  - " << member.first << " (" << (group.kilobyte / 1024) << " MiB, " << member.second
+                       << " files)" << endl;
+                }
+            }
+            if (!next.empty()) {
+                ss << "next page: " << next << endl;
+            }
+            for (const auto &peer : unanswered) {
+                ss << "no answer from " << peer << endl;
+            }
+            res.body = ss.str();
+        }
+        compress_response(req, res);
+        return res;
+    }));
+}
@@ -0,0 +1,54 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "crow.h"
+#include "compression.h"
+
+// Coordinator mode: one web UI for the indexers of several machines. Queries are sent to every peer at
+// the same time and their pages are merged into one top-N without duplicates. A peer that does not
+// answer in time is left out, the others make up a partial result that names it.
+// The next page continues every peer where its part of the merged page ended: the "next" link holds the
+// position in the listing of each of them, their own cursor and the rows of their page already shown.
+
+// an indexer the coordinator asks
+struct peer
+{
+    std::string host;
+    std::string port;
+
+    // "host:port", or "host" for the default port 8888; throws std::invalid_argument for anything else
+    static peer parse(const std::string &endpoint);
+
+    std::string name() const { return host + ':' + port; }
+};
+
+struct peer_response
+{
+    bool ok = false; // answered 200 in time
+    int status = 0;  // 0 without an answer
+    std::string body;
+    std::string error; // why it is not ok
+    double seconds = 0;
+};
+
+// Posts body to target on every peer at the same time, on the calling thread, and returns their answers
+// in the order of peers. Waits at most timeout, for all of them together.
+std::vector<peer_response> ask_peers(const std::vector<peer> &peers, const std::string &target,
+                                     const std::string &body, std::chrono::milliseconds timeout);
+
+// the same with a target and body for every peer, peers with an empty target are not asked
+std::vector<peer_response> ask_peers(const std::vector<peer> &peers, const std::vector<std::string> &targets,
+                                     const std::vector<std::string> &bodies, std::chrono::milliseconds timeout);
+
+// index.html, /status, /metrics and /find, /match, /by_size, /by_date, /prefix and /dupes over all peers,
+// each of which may take timeout to answer
+void add_coordinator_routes(crow::App<> &app, const std::vector<peer> &peers, std::chrono::milliseconds timeout,
+                            const static_asset &index_html);
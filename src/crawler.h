@@ -0,0 +1,242 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <climits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "node_store.h"
+#include "thread_pool.h"
+
+// one directory entry, with the same fields `find -printf "%k\t%i\t%A+\t%Y\t%p\n"` writes
+struct crawl_entry
+{
+    uint64_t kilobyte;
+    uint64_t inode;
+    int64_t atime; // local wall-clock time, see parse_timestamp()
+    char filetype;
+    std::string_view name;
+};
+
+struct crawl_root_stats
+{
+    std::string root;
+    size_t entries;
+    size_t errors;
+    double seconds;
+};
+
+// Walks directory trees in parallel, one task per directory on a work-stealing pool. Directories are read
+// with getdents64 and every entry is statx'ed relative to its open directory, symbolic links are not
+// followed. Entries are passed to sink(dir, entries) in batches from pool threads, in no particular
+// order; an entry's full path is dir + '/' + name.
+class crawler
+{
+private:
+    struct linux_dirent64
+    {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    struct root_state
+    {
+        std::string path;
+        std::atomic<size_t> entries{0};
+        std::atomic<size_t> errors{0};
+        std::atomic<size_t> pending{0}; // directories queued or being read
+        std::atomic<int64_t> finished_ns{0};
+    };
+
+    thread_pool &pool_;
+    std::chrono::steady_clock::time_point start_;
+
+    static char filetype(uint32_t mode)
+    {
+        switch (mode & S_IFMT) {
+        case S_IFREG: return 'f';
+        case S_IFDIR: return 'd';
+        case S_IFLNK: return 'l';
+        case S_IFCHR: return 'c';
+        case S_IFBLK: return 'b';
+        case S_IFIFO: return 'p';
+        case S_IFSOCK: return 's';
+        default: return 'U';
+        }
+    }
+
+    // fills entry from statx, returns false if the entry is gone or cannot be accessed
+    static bool stat_entry(int dirfd, const char *name, crawl_entry &entry, bool &is_dir)
+    {
+        struct statx st{};
+        if (::statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                    STATX_TYPE | STATX_INO | STATX_ATIME | STATX_BLOCKS, &st) == -1) {
+            return false;
+        }
+        entry.kilobyte = (st.stx_blocks * 512 + 1023) / 1024;
+        entry.inode = st.stx_ino;
+        // %A+ is printed in local time, keep doing the same
+        const time_t seconds = static_cast<time_t>(st.stx_atime.tv_sec);
+        struct tm local{};
+        localtime_r(&seconds, &local);
+        entry.atime = (static_cast<int64_t>(seconds) + local.tm_gmtoff) * 1000000000 + st.stx_atime.tv_nsec;
+        entry.filetype = filetype(st.stx_mode);
+        is_dir = entry.filetype == 'd';
+        if (entry.filetype == 'l') {
+            // %Y follows symbolic links
+            struct statx target{};
+            if (::statx(dirfd, name, AT_NO_AUTOMOUNT, STATX_TYPE, &target) == 0) {
+                entry.filetype = filetype(target.stx_mode);
+            } else {
+                entry.filetype = errno == ENOENT ? 'N' : errno == ELOOP ? 'L' : '?';
+            }
+        }
+        return true;
+    }
+
+    // reads one directory, returns the number of entries that could not be read
+    template <typename Sink>
+    static size_t read_directory(const std::string &dir, Sink &sink, std::vector<std::string> &subdirectories,
+                                 size_t &count)
+    {
+        size_t errors = 0;
+        const int fd = ::open(dir.empty() ? "/" : dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd == -1) {
+            return 1;
+        }
+        std::vector<char> buffer(64 * 1024);
+        std::vector<crawl_entry> entries;
+        while (true) {
+            const long n = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (n <= 0) {
+                if (n < 0) {
+                    errors++;
+                }
+                break;
+            }
+            entries.clear();
+            for (long pos = 0; pos < n;) {
+                const auto *d = reinterpret_cast<const linux_dirent64 *>(buffer.data() + pos);
+                pos += d->d_reclen;
+                if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                    continue;
+                }
+                crawl_entry entry{};
+                bool is_dir = false;
+                if (!stat_entry(fd, d->d_name, entry, is_dir)) {
+                    errors++;
+                    continue;
+                }
+                entry.name = d->d_name;
+                entries.push_back(entry);
+                if (is_dir) {
+                    subdirectories.push_back(dir + '/' + d->d_name);
+                }
+            }
+            count += entries.size();
+            sink(std::string_view(dir), entries);
+        }
+        ::close(fd);
+        return errors;
+    }
+
+    template <typename Sink>
+    void crawl_directory(task_group &group, root_state &root, std::string dir, Sink &sink)
+    {
+        std::vector<std::string> subdirectories;
+        size_t entries = 0;
+        root.errors += read_directory(dir, sink, subdirectories, entries);
+        root.entries += entries;
+        // count the children before this directory is done, so pending only reaches zero at the very end
+        root.pending += subdirectories.size();
+        for (auto &subdirectory : subdirectories) {
+            group.run([this, &group, &root, &sink, subdirectory = std::move(subdirectory)]() mutable {
+                crawl_directory(group, root, std::move(subdirectory), sink);
+            });
+        }
+        if (--root.pending == 0) {
+            root.finished_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_).count();
+        }
+    }
+
+public:
+    explicit crawler(thread_pool &pool) : pool_(pool) {}
+
+    // reads a single directory (as crawled, so "" for the file system root) without descending into it,
+    // on the calling thread. Returns false if it could not be read completely.
+    template <typename Sink>
+    static bool list(const std::string &dir, Sink sink)
+    {
+        std::vector<std::string> subdirectories;
+        size_t entries = 0;
+        return read_directory(dir, sink, subdirectories, entries) == 0;
+    }
+
+    // roots are crawled concurrently, the stats tell how long each one took on its own
+    template <typename Sink>
+    std::vector<crawl_root_stats> crawl(const std::vector<std::string> &roots, Sink sink)
+    {
+        start_ = std::chrono::steady_clock::now();
+        std::vector<std::unique_ptr<root_state>> states;
+        task_group group(pool_);
+        for (const auto &path : roots) {
+            states.emplace_back(new root_state);
+            auto &root = *states.back();
+            // "/mnt/" is crawled as "/mnt", the file system root as "" so children are joined as "/bin"
+            root.path = path;
+            if (root.path.empty() || root.path[0] != '/') {
+                char cwd[PATH_MAX];
+                root.path = std::string(::getcwd(cwd, sizeof(cwd)) ? cwd : "") + '/' + root.path;
+            }
+            while (root.path.size() > 1 && root.path.back() == '/') {
+                root.path.pop_back();
+            }
+            const std::string dir = root.path == "/" ? std::string() : root.path;
+
+            // the root itself is an entry too, in the directory above it
+            const size_t slash = dir.find_last_of('/');
+            const std::string parent = slash == std::string::npos ? std::string() : dir.substr(0, slash);
+            const std::string name = slash == std::string::npos ? std::string() : dir.substr(slash + 1);
+            crawl_entry entry{};
+            bool is_dir = false;
+            if (!stat_entry(AT_FDCWD, root.path.c_str(), entry, is_dir)) {
+                root.errors++;
+                continue;
+            }
+            entry.name = name;
+            root.entries++;
+            sink(std::string_view(parent), std::vector<crawl_entry>{entry});
+            if (is_dir) {
+                root.pending++;
+                group.run([this, &group, &root, &sink, dir] { crawl_directory(group, root, dir, sink); });
+            }
+        }
+        group.wait();
+
+        std::vector<crawl_root_stats> stats;
+        for (const auto &root : states) {
+            stats.push_back({root->path, root->entries, root->errors, root->finished_ns / 1e9});
+        }
+        return stats;
+    }
+};
@@ -0,0 +1,243 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "column.h"
+#include "snapshot.h"
+#include "node_store.h"
+#include "murmur3.h"
+
+// Groups directories that are sorted, or at least kept together, by tree hash: every hash that occurs
+// more than once is a group. Returns the (first, last) ranges of the groups, ordered by subtree size,
+// largest first, and then by hash.
+template <typename hash_of_t, typename cum_kilobyte_of_t>
+std::vector<std::pair<size_t, size_t>> group_by_hash(size_t count, hash_of_t hash_of, cum_kilobyte_of_t cum_kilobyte_of)
+{
+    std::vector<std::pair<size_t, size_t>> groups;
+    for (size_t first = 0, last; first < count; first = last) {
+        last = first + 1;
+        while (last < count && hash_of(last) == hash_of(first)) {
+            last++;
+        }
+        if (last - first > 1) {
+            groups.emplace_back(first, last);
+        }
+    }
+    std::sort(groups.begin(), groups.end(), [&](const auto &lhs, const auto &rhs) {
+        const auto l = cum_kilobyte_of(lhs.first), r = cum_kilobyte_of(rhs.first);
+        return l != r ? l > r : hash_of(lhs.first) < hash_of(rhs.first);
+    });
+    return groups;
+}
+
+// Directories with identical tree hashes, grouped once after hashing. Groups are ordered by subtree size,
+// largest first, so all groups above a size threshold are a prefix of the array.
+class dupe_groups
+{
+private:
+    column<hash128> hash_;
+    column<uint64_t> cum_kilobyte_; // descending
+    column<uint32_t> member_offset_; // members of group i are members_[member_offset_[i] .. member_offset_[i + 1]>
+    column<node_id> members_;
+    column<node_id> by_hash_; // every directory, by tree hash and then id
+
+public:
+    void build(const node_store &nodes)
+    {
+        std::vector<std::pair<hash128, node_id>> by_hash;
+        for (const auto &node : nodes) {
+            if (node.filetype() == 'd') {
+                by_hash.emplace_back(node.my_hash(), node.id());
+            }
+        }
+        std::sort(by_hash.begin(), by_hash.end());
+        by_hash_.clear();
+        for (const auto &dir : by_hash) {
+            by_hash_.push_back(dir.second);
+        }
+
+        const auto groups = group_by_hash(
+            by_hash.size(), [&](size_t i) { return by_hash[i].first; },
+            [&](size_t i) { return nodes[by_hash[i].second].cum_kilobyte(); });
+        hash_.clear();
+        cum_kilobyte_.clear();
+        member_offset_.clear();
+        members_.clear();
+        for (const auto &group : groups) {
+            hash_.push_back(by_hash[group.first].first);
+            cum_kilobyte_.push_back(nodes[by_hash[group.first].second].cum_kilobyte());
+            member_offset_.push_back(static_cast<uint32_t>(members_.size()));
+            for (size_t i = group.first; i < group.second; i++) {
+                members_.push_back(by_hash[i].second);
+            }
+        }
+        member_offset_.push_back(static_cast<uint32_t>(members_.size()));
+    }
+
+    // After index_version::update(): directories that were hashed again (new ids, the inserted ones too)
+    // are merged into by_hash with their new hash, the others only get their new ids. Groups with a member
+    // that was deleted or hashed again and the groups of the new hashes are grouped again, the others keep
+    // their members and size.
+    void update(const node_store &nodes, const id_remap &remap, const std::vector<node_id> &rehashed)
+    {
+        const auto now = remap.table();
+        std::vector<std::pair<hash128, node_id>> added;
+        std::vector<char> is_moved(nodes.size(), 0);
+        for (node_id id : rehashed) {
+            if (nodes[id].filetype() == 'd') {
+                added.emplace_back(nodes[id].my_hash(), id);
+                is_moved[id] = 1;
+            }
+        }
+        std::sort(added.begin(), added.end());
+        auto gone = [&](node_id id) { return id == no_node || is_moved[id]; };
+
+        std::vector<node_id> by_hash;
+        by_hash.reserve(by_hash_.size() + added.size());
+        auto next = added.begin();
+        for (node_id old : std::as_const(by_hash_)) {
+            const node_id id = now[old];
+            if (gone(id)) {
+                continue;
+            }
+            if (next != added.end()) {
+                const auto dir = std::make_pair(nodes[id].my_hash(), id);
+                for (; next != added.end() && *next < dir; ++next) {
+                    by_hash.push_back(next->second);
+                }
+            }
+            by_hash.push_back(id);
+        }
+        for (; next != added.end(); ++next) {
+            by_hash.push_back(next->second);
+        }
+        by_hash_.clear();
+        by_hash_.append(by_hash.begin(), by_hash.end());
+
+        // the hashes to group again, the other groups remain as they are
+        std::vector<hash128> regrouped;
+        for (const auto &dir : added) {
+            regrouped.push_back(dir.first);
+        }
+        for (size_t group = 0; group < size(); group++) {
+            for (node_id old : members(group)) {
+                if (gone(now[old])) {
+                    regrouped.push_back(hash(group));
+                    break;
+                }
+            }
+        }
+        std::sort(regrouped.begin(), regrouped.end());
+        regrouped.erase(std::unique(regrouped.begin(), regrouped.end()), regrouped.end());
+        std::vector<size_t> kept;
+        for (size_t group = 0; group < size(); group++) {
+            if (!std::binary_search(regrouped.begin(), regrouped.end(), hash(group))) {
+                kept.push_back(group);
+            }
+        }
+
+        std::vector<std::pair<hash128, node_id>> candidates;
+        auto first = by_hash.begin();
+        for (const auto &hash : regrouped) {
+            first = std::partition_point(first, by_hash.end(), [&](node_id id) { return nodes[id].my_hash() < hash; });
+            for (; first != by_hash.end() && nodes[*first].my_hash() == hash; ++first) {
+                candidates.emplace_back(hash, *first);
+            }
+        }
+        const auto groups = group_by_hash(
+            candidates.size(), [&](size_t i) { return candidates[i].first; },
+            [&](size_t i) { return nodes[candidates[i].second].cum_kilobyte(); });
+
+        // both lists are ordered already, merge them
+        column<hash128> new_hash;
+        column<uint64_t> new_cum_kilobyte;
+        column<uint32_t> new_member_offset;
+        column<node_id> new_members;
+        size_t old_group = 0;
+        auto new_group = groups.begin();
+        while (old_group < kept.size() || new_group != groups.end()) {
+            bool take_old = new_group == groups.end();
+            if (!take_old && old_group < kept.size()) {
+                const uint64_t l = cum_kilobyte(kept[old_group]);
+                const uint64_t r = nodes[candidates[new_group->first].second].cum_kilobyte();
+                take_old = l != r ? l > r : hash(kept[old_group]) < candidates[new_group->first].first;
+            }
+            new_member_offset.push_back(static_cast<uint32_t>(new_members.size()));
+            if (take_old) {
+                const size_t group = kept[old_group++];
+                new_hash.push_back(hash(group));
+                new_cum_kilobyte.push_back(cum_kilobyte(group));
+                for (node_id old : members(group)) {
+                    new_members.push_back(now[old]);
+                }
+            } else {
+                new_hash.push_back(candidates[new_group->first].first);
+                new_cum_kilobyte.push_back(nodes[candidates[new_group->first].second].cum_kilobyte());
+                for (size_t i = new_group->first; i < new_group->second; i++) {
+                    new_members.push_back(candidates[i].second);
+                }
+                ++new_group;
+            }
+        }
+        new_member_offset.push_back(static_cast<uint32_t>(new_members.size()));
+        hash_.swap(new_hash);
+        cum_kilobyte_.swap(new_cum_kilobyte);
+        member_offset_.swap(new_member_offset);
+        members_.swap(new_members);
+    }
+
+    size_t size() const { return hash_.size(); }
+    hash128 hash(size_t group) const { return hash_[group]; }
+    uint64_t cum_kilobyte(size_t group) const { return cum_kilobyte_[group]; }
+    id_range members(size_t group) const
+    {
+        return {members_.data() + member_offset_[group], members_.data() + member_offset_[group + 1]};
+    }
+
+    // every directory, also the ones without a copy, ordered by tree hash and then id
+    const column<node_id> &by_hash() const { return by_hash_; }
+
+    // number of groups of at least kilobyte, they are groups [0, n>
+    size_t count_at_least(uint64_t kilobyte) const
+    {
+        return static_cast<size_t>(std::partition_point(cum_kilobyte_.begin(), cum_kilobyte_.end(),
+                                                        [kilobyte](uint64_t kb) { return kb >= kilobyte; }) -
+                                   cum_kilobyte_.begin());
+    }
+
+    size_t memory_usage() const
+    {
+        return hash_.heap_bytes() + cum_kilobyte_.heap_bytes() + member_offset_.heap_bytes() + members_.heap_bytes() +
+               by_hash_.heap_bytes();
+    }
+
+    void save(snapshot_writer &writer) const
+    {
+        writer.add("dupes.hash", hash_);
+        writer.add("dupes.cum_kilobyte", cum_kilobyte_);
+        writer.add("dupes.member_offset", member_offset_);
+        writer.add("dupes.members", members_);
+        writer.add("dupes.by_hash", by_hash_);
+    }
+
+    void load(const snapshot_reader &reader)
+    {
+        reader.load("dupes.hash", hash_);
+        reader.load("dupes.cum_kilobyte", cum_kilobyte_);
+        reader.load("dupes.member_offset", member_offset_);
+        reader.load("dupes.members", members_);
+        reader.load("dupes.by_hash", by_hash_);
+        if (cum_kilobyte_.size() != size() || member_offset_.size() != size() + 1) {
+            throw std::runtime_error("snapshot dupe groups are inconsistent");
+        }
+    }
+};
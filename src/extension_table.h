@@ -0,0 +1,139 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+#include <cctype>
+#include <stdexcept>
+#include <utility>
+
+#include "column.h"
+#include "snapshot.h"
+#include "node_store.h"
+#include "basename_dictionary.h"
+
+using extension_id = uint16_t;
+
+// The extension of every distinct basename, as a small id, for grouping entries by extension without
+// looking at their names. Extensions are compared case-insensitively and stored in lower case; id 0 is
+// "no extension".
+class extension_table
+{
+private:
+    column<extension_id> of_run_; // by basename run
+    column<uint32_t> offsets_;    // of the names in arena_, plus the end of the last one
+    column<char> arena_;
+
+    // id of the extension of basename, a new one if ids does not know it yet
+    extension_id id_of(std::string_view basename, std::unordered_map<std::string, extension_id> &ids)
+    {
+        std::string lower(extension_of(basename));
+        for (char &c : lower) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        auto iter = ids.find(lower);
+        if (iter == ids.end()) {
+            if (ids.size() >= max_extensions) {
+                return 0;
+            }
+            iter = ids.emplace(lower, static_cast<extension_id>(size())).first;
+            arena_.append(lower.begin(), lower.end());
+            offsets_.push_back(static_cast<uint32_t>(arena_.size()));
+        }
+        return iter->second;
+    }
+
+public:
+    static constexpr size_t max_length = 12;
+    static constexpr size_t max_extensions = UINT16_MAX;
+
+    // "tar.gz" counts as "gz", names starting with their only dot (".bashrc") have none, neither do
+    // names whose last part is too long or contains anything but letters and digits to be an extension
+    static std::string_view extension_of(std::string_view basename)
+    {
+        const size_t dot = basename.find_last_of('.');
+        if (dot == std::string_view::npos || dot == 0 || dot + 1 == basename.size() ||
+            basename.size() - dot - 1 > max_length) {
+            return {};
+        }
+        const auto extension = basename.substr(dot + 1);
+        for (char c : extension) {
+            if (!std::isalnum(static_cast<unsigned char>(c))) {
+                return {};
+            }
+        }
+        return extension;
+    }
+
+    // once max_extensions are known, further ones count as no extension
+    void build(const node_store &nodes, const basename_dictionary &basenames)
+    {
+        of_run_.clear();
+        offsets_.assign(2, 0); // id 0, no extension
+        arena_.clear();
+        std::unordered_map<std::string, extension_id> ids{{"", 0}};
+        of_run_.reserve(basenames.size());
+        for (size_t run = 0; run < basenames.size(); run++) {
+            of_run_.push_back(id_of(basenames.name(nodes, run), ids));
+        }
+    }
+
+    // after basename_dictionary::update(), with the same run_remap and added_runs: runs that remain keep
+    // their extension, only the added ones are looked at
+    void update(const node_store &nodes, const basename_dictionary &basenames, const std::vector<size_t> &run_remap,
+                const std::vector<size_t> &added_runs)
+    {
+        column<extension_id> of_run;
+        of_run.resize(basenames.size());
+        extension_id *out = of_run.data();
+        for (size_t run = 0; run < run_remap.size(); run++) {
+            if (run_remap[run] != basename_dictionary::npos) {
+                out[run_remap[run]] = std::as_const(of_run_)[run];
+            }
+        }
+        if (!added_runs.empty()) {
+            std::unordered_map<std::string, extension_id> ids;
+            for (size_t id = 0; id < size(); id++) {
+                ids.emplace(name(static_cast<extension_id>(id)), static_cast<extension_id>(id));
+            }
+            for (size_t run : added_runs) {
+                out[run] = id_of(basenames.name(nodes, run), ids);
+            }
+        }
+        of_run_.swap(of_run);
+    }
+
+    // distinct extensions, including "no extension"
+    size_t size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+    extension_id of_run(size_t run) const { return of_run_[run]; }
+    std::string_view name(extension_id id) const
+    {
+        return {arena_.data() + offsets_[id], offsets_[id + 1] - offsets_[id]};
+    }
+
+    size_t memory_usage() const { return of_run_.heap_bytes() + offsets_.heap_bytes() + arena_.heap_bytes(); }
+
+    void save(snapshot_writer &writer) const
+    {
+        writer.add("extensions.of_run", of_run_);
+        writer.add("extensions.offsets", offsets_);
+        writer.add("extensions.arena", arena_);
+    }
+
+    void load(const snapshot_reader &reader)
+    {
+        reader.load("extensions.of_run", of_run_);
+        reader.load("extensions.offsets", offsets_);
+        reader.load("extensions.arena", arena_);
+        if (offsets_.empty() || offsets_.back() != arena_.size()) {
+            throw std::runtime_error("snapshot extension columns are inconsistent");
+        }
+    }
+};
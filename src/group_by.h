@@ -0,0 +1,341 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+
+#include "index_version.h"
+#include "thread_pool.h"
+
+// Sums of entries and sizes over the whole index, grouped by any combination of extension, age, type
+// and the subtree below a directory an entry is in.
+//
+// Every key maps an entry to a small number, the numbers of all keys together to one cell. Partitions of
+// consecutive entries are aggregated on a thread pool, each worker into its own cells (a dense array if
+// there are few of them, a hash map otherwise), and the cells of all workers are merged at the end. Only
+// the columns the query needs are read, the extension of an entry is looked up by basename run.
+
+enum class stats_key { extension, age, type, subtree };
+
+inline const char *stats_key_name(stats_key key)
+{
+    switch (key) {
+    case stats_key::extension: return "extension";
+    case stats_key::age: return "age";
+    case stats_key::type: return "type";
+    case stats_key::subtree: return "subtree";
+    }
+    return "";
+}
+
+// throws for names of unknown keys
+inline stats_key parse_stats_key(std::string_view name)
+{
+    for (auto key : {stats_key::extension, stats_key::age, stats_key::type, stats_key::subtree}) {
+        if (name == stats_key_name(key)) {
+            return key;
+        }
+    }
+    throw std::runtime_error("unknown group: " + std::string(name));
+}
+
+struct stats_query
+{
+    std::vector<stats_key> group_by;
+    std::string under;  // only entries below this directory, e.g. "/mnt2/NAS"; all entries if empty
+    char filetype = 0;  // only entries of this type, e.g. 'f'; all if 0
+    time_range accessed; // only entries accessed in this range
+    int64_t now = local_now(); // ages are relative to this
+};
+
+struct stats_group
+{
+    std::vector<std::string> key; // a value for every key of group_by, in that order
+    uint64_t entries = 0;
+    uint64_t kilobyte = 0;
+};
+
+struct stats_result
+{
+    std::vector<stats_group> groups; // largest first
+    uint64_t entries = 0;            // of all groups
+    uint64_t kilobyte = 0;
+
+    void sort_groups()
+    {
+        std::sort(groups.begin(), groups.end(), [](const stats_group &lhs, const stats_group &rhs) {
+            return lhs.kilobyte != rhs.kilobyte ? lhs.kilobyte > rhs.kilobyte : lhs.key < rhs.key;
+        });
+    }
+};
+
+// the results of the same query on several indexes (shards) as one, groups with the same key added up
+inline stats_result merge_stats(const std::vector<stats_result> &parts)
+{
+    if (parts.size() == 1) {
+        return parts[0];
+    }
+    std::map<std::vector<std::string>, stats_group> groups;
+    stats_result result;
+    for (const auto &part : parts) {
+        for (const auto &group : part.groups) {
+            auto &sums = groups[group.key];
+            sums.entries += group.entries;
+            sums.kilobyte += group.kilobyte;
+        }
+        result.entries += part.entries;
+        result.kilobyte += part.kilobyte;
+    }
+    for (auto &[key, group] : groups) {
+        group.key = key;
+        result.groups.push_back(std::move(group));
+    }
+    result.sort_groups();
+    return result;
+}
+
+class stats_aggregation
+{
+private:
+    static constexpr int64_t ns_per_day = int64_t(86400) * 1000000000;
+    static constexpr size_t num_ages = 7;
+    static constexpr uint32_t outside = UINT32_MAX;    // not below the directory
+    static constexpr uint32_t directly = UINT32_MAX - 1; // in the directory itself
+    static constexpr size_t max_dense_cells = 64 * 1024;
+    static constexpr size_t entries_per_partition = 64 * 1024;
+
+    struct totals
+    {
+        uint64_t entries = 0;
+        uint64_t kilobyte = 0;
+    };
+
+    // the cells of one worker
+    struct partial
+    {
+        std::vector<totals> dense;
+        std::unordered_map<uint64_t, totals> sparse;
+    };
+
+    const index_version &index_;
+    const stats_query &query_;
+    dir_id root_ = no_dir;
+    std::vector<uint32_t> subtree_of_dir_; // for every directory, which child of root_ it is below
+    std::vector<dir_id> subtrees_;         // the children of root_
+    std::vector<size_t> radix_;            // cells of every key
+    size_t cells_ = 1;                     // of all keys together
+    int64_t age_bounds_[num_ages - 2];     // entries accessed before bound i are older than age bucket i
+
+    static const char *age_name(size_t age)
+    {
+        static const char *names[num_ages] = {"< 1 month", "1-6 months", "6-12 months", "1-2 years",
+                                              "2-5 years", "> 5 years", "unknown"};
+        return names[age];
+    }
+
+    // the directory of a path like find prints them, no_dir if it is not in the index
+    dir_id find_dir(std::string_view path) const
+    {
+        while (path.size() > 1 && path.back() == '/') {
+            path.remove_suffix(1);
+        }
+        const auto &dirs = index_.nodes.dirs();
+        dir_id dir = no_dir;
+        while (true) {
+            const size_t slash = path.find('/');
+            dir = dirs.find(dir, path.substr(0, slash));
+            if (dir == no_dir || slash == std::string_view::npos || slash + 1 == path.size()) {
+                return dir;
+            }
+            path.remove_prefix(slash + 1);
+        }
+    }
+
+    // directories are always interned after their parent, so one pass in id order labels all of them
+    void label_subtrees()
+    {
+        const auto &dirs = index_.nodes.dirs();
+        subtree_of_dir_.assign(dirs.size(), outside);
+        if (root_ == no_dir) {
+            return;
+        }
+        for (dir_id dir = root_; dir < dirs.size(); dir++) {
+            const dir_id parent = dirs.parent(dir);
+            if (dir == root_) {
+                subtree_of_dir_[dir] = directly;
+            } else if (parent == root_) {
+                subtree_of_dir_[dir] = static_cast<uint32_t>(subtrees_.size());
+                subtrees_.push_back(dir);
+            } else if (parent != no_dir) {
+                subtree_of_dir_[dir] = subtree_of_dir_[parent];
+            }
+        }
+    }
+
+    size_t age_of(int64_t atime) const
+    {
+        if (atime == no_timestamp) {
+            return num_ages - 1;
+        }
+        size_t age = 0;
+        for (int64_t bound : age_bounds_) {
+            age += atime < bound;
+        }
+        return age;
+    }
+
+    void aggregate_partition(size_t partition, partial &cells) const
+    {
+        const auto &nodes = index_.nodes;
+        const node_id first = static_cast<node_id>(partition * entries_per_partition);
+        const node_id last = static_cast<node_id>(std::min(nodes.size(), (partition + 1) * entries_per_partition));
+        const bool filter_dirs = !subtree_of_dir_.empty();
+        size_t run = index_.basenames.run_of(first);
+        node_id block_end = first;
+        for (node_id id = first; id < last; id++) {
+            if (id >= block_end) {
+                if ((id = index_.times.skip(id, last, query_.accessed)) == last) {
+                    break;
+                }
+                block_end = index_.times.block_end(id);
+            }
+            while (id >= index_.basenames.last(run)) {
+                run++;
+            }
+            const auto node = nodes[id];
+            if ((query_.filetype && node.filetype() != query_.filetype) || !query_.accessed.contains(node.atime())) {
+                continue;
+            }
+            uint32_t subtree = directly;
+            if (filter_dirs) {
+                const dir_id dir = node.parent_dir();
+                subtree = dir == no_dir ? outside : subtree_of_dir_[dir];
+                if (subtree == outside) {
+                    continue;
+                }
+            }
+            uint64_t cell = 0;
+            for (size_t k = 0; k < query_.group_by.size(); k++) {
+                uint64_t value = 0;
+                switch (query_.group_by[k]) {
+                case stats_key::extension: value = index_.extensions.of_run(run); break;
+                case stats_key::age: value = age_of(node.atime()); break;
+                case stats_key::type: value = static_cast<unsigned char>(node.filetype()); break;
+                case stats_key::subtree: value = subtree == directly ? subtrees_.size() : subtree; break;
+                }
+                cell = cell * radix_[k] + value;
+            }
+            auto &sums = cells.dense.empty() ? cells.sparse[cell] : cells.dense[cell];
+            sums.entries++;
+            sums.kilobyte += node.kilobyte();
+        }
+    }
+
+    std::vector<std::string> key_of(uint64_t cell) const
+    {
+        std::vector<std::string> key(query_.group_by.size());
+        for (size_t k = query_.group_by.size(); k-- > 0;) {
+            const uint64_t value = cell % radix_[k];
+            cell /= radix_[k];
+            switch (query_.group_by[k]) {
+            case stats_key::extension:
+                key[k] = value == 0 ? "(none)" : std::string(index_.extensions.name(static_cast<extension_id>(value)));
+                break;
+            case stats_key::age: key[k] = age_name(value); break;
+            case stats_key::type: key[k] = std::string(1, static_cast<char>(value)); break;
+            case stats_key::subtree:
+                key[k] = index_.nodes.dirs().path(value == subtrees_.size() ? root_ : subtrees_[value]);
+                key[k] = key[k].empty() ? "/" : key[k];
+                break;
+            }
+        }
+        return key;
+    }
+
+public:
+    stats_aggregation(const index_version &index, const stats_query &query) : index_(index), query_(query)
+    {
+        const bool by_subtree =
+            std::find(query.group_by.begin(), query.group_by.end(), stats_key::subtree) != query.group_by.end();
+        if (!query.under.empty() || by_subtree) {
+            root_ = find_dir(query.under.empty() ? "/" : query.under);
+            label_subtrees();
+        }
+        const int64_t days[num_ages - 2] = {30, 182, 365, 730, 1825};
+        for (size_t i = 0; i < num_ages - 2; i++) {
+            age_bounds_[i] = query.now - days[i] * ns_per_day;
+        }
+        for (auto key : query.group_by) {
+            switch (key) {
+            case stats_key::extension: radix_.push_back(std::max<size_t>(1, index.extensions.size())); break;
+            case stats_key::age: radix_.push_back(num_ages); break;
+            case stats_key::type: radix_.push_back(256); break;
+            case stats_key::subtree: radix_.push_back(subtrees_.size() + 1); break;
+            }
+            // a hash map can hold any number of cells, as long as their numbers fit in 64 bits
+            if (radix_.back() > UINT64_MAX / cells_) {
+                throw std::runtime_error("too many groups");
+            }
+            cells_ *= radix_.back();
+        }
+    }
+
+    stats_result run(thread_pool &pool = default_pool())
+    {
+        const auto &nodes = index_.nodes;
+        stats_result result;
+        if (!query_.under.empty() && root_ == no_dir) {
+            return result;
+        }
+        const size_t num_partitions = (nodes.size() + entries_per_partition - 1) / entries_per_partition;
+        const size_t num_workers = std::max<size_t>(1, std::min(pool.size(), num_partitions));
+        std::vector<partial> partials(num_workers);
+        std::atomic<size_t> next_partition{0};
+        {
+            task_group group(pool);
+            for (size_t w = 0; w < num_workers; w++) {
+                group.run([&, w] {
+                    if (cells_ <= max_dense_cells) {
+                        partials[w].dense.resize(cells_);
+                    }
+                    for (size_t partition; (partition = next_partition++) < num_partitions;) {
+                        aggregate_partition(partition, partials[w]);
+                    }
+                });
+            }
+            group.wait();
+        }
+
+        std::unordered_map<uint64_t, totals> merged;
+        for (const auto &cells : partials) {
+            for (size_t cell = 0; cell < cells.dense.size(); cell++) {
+                if (cells.dense[cell].entries > 0) {
+                    merged[cell].entries += cells.dense[cell].entries;
+                    merged[cell].kilobyte += cells.dense[cell].kilobyte;
+                }
+            }
+            for (const auto &[cell, sums] : cells.sparse) {
+                merged[cell].entries += sums.entries;
+                merged[cell].kilobyte += sums.kilobyte;
+            }
+        }
+        for (const auto &[cell, sums] : merged) {
+            result.groups.push_back({key_of(cell), sums.entries, sums.kilobyte});
+            result.entries += sums.entries;
+            result.kilobyte += sums.kilobyte;
+        }
+        result.sort_groups();
+        return result;
+    }
+};
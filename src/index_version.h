@@ -0,0 +1,291 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+
+#include "column.h"
+#include "snapshot.h"
+#include "node_store.h"
+#include "basename_dictionary.h"
+#include "extension_table.h"
+#include "trigram_index.h"
+#include "dupe_groups.h"
+#include "time_index.h"
+#include "tree_hash.h"
+#include "thread_pool.h"
+
+// order of nodes_by_size: largest first, equal sizes in entry order (see node_store::entry_less)
+inline bool larger_first(const node_store &nodes, node_id id1, node_id id2)
+{
+    const auto n1 = nodes[id1], n2 = nodes[id2];
+    if (n1.kilobyte() == n2.kilobyte()) {
+       return node_store::entry_less(nodes, id1, nodes, id2);
+    }
+    return n1.kilobyte() > n2.kilobyte();
+}
+
+struct index_update_stats
+{
+    size_t unchanged = 0;
+    size_t modified = 0;
+    size_t inserted = 0;
+    size_t deleted = 0;
+    size_t new_basenames = 0;
+    size_t hashed = 0;
+    double compare_seconds = 0;
+    double merge_seconds = 0;
+    double hash_seconds = 0;
+};
+
+// Everything requests read. Once published a version is never modified again: updates are applied to
+// a copy, and readers keep the version they started with for as long as they hold on to it.
+struct index_version
+{
+    node_store nodes;
+    basename_dictionary basenames;
+    extension_table extensions;
+    dupe_groups dupes;
+    column<node_id> nodes_by_size;
+    column<node_id> nodes_by_atime;
+    time_index times;
+    trigram_index trigrams;
+
+    // Patches the index with a fresh listing (unsorted and not linked) instead of building it again.
+    // Entries are matched by path and inode: matches with another size or access time are modified in
+    // place, the rest of the listing is inserted. Entries in the listed directories that were not
+    // matched are deleted, together with whatever was below them. Without dirs the listing covers
+    // everything. Apart from copying the columns that change, the work is proportional to the changes:
+    // inserts and deletes renumber the entries, and that id_remap is applied to the tree links, name
+    // indexes, orders, time blocks and dupe groups instead of building them again. Subtree hashes are
+    // only recomputed on the paths from changed entries up to their roots, and only the dupe groups of
+    // changed hashes are grouped again.
+    index_update_stats update(node_store &&fresh, const std::vector<std::string> *dirs = nullptr)
+    {
+        index_update_stats stats;
+        auto start = std::chrono::steady_clock::now();
+        auto lap = [&start] {
+            const auto now = std::chrono::steady_clock::now();
+            const std::chrono::duration<double> elapsed = now - start;
+            start = now;
+            return elapsed.count();
+        };
+
+        const auto dir_remap = nodes.dirs().merge(fresh.dirs());
+        auto parent_of = [&](node_id id) {
+            return fresh.parent_dir(id) == no_dir ? no_dir : dir_remap[fresh.parent_dir(id)];
+        };
+        std::vector<dir_id> listed;
+        if (dirs) {
+            for (const auto &dir : *dirs) {
+                listed.push_back(nodes.dirs().intern_path(dir));
+            }
+            std::sort(listed.begin(), listed.end());
+            listed.erase(std::unique(listed.begin(), listed.end()), listed.end());
+        }
+
+        std::vector<node_id> match(fresh.size());
+        const size_t chunk = 16384;
+        parallel_for(default_pool(), (fresh.size() + chunk - 1) / chunk, [&](size_t c) {
+            for (size_t id = c * chunk; id < std::min(fresh.size(), (c + 1) * chunk); id++) {
+                const auto f = fresh[id];
+                const dir_id parent = parent_of(f.id());
+                match[id] = no_node;
+                // the same path can occur more than once, e.g. when a file was replaced while find ran
+                for (node_id old = basenames.find_entry(nodes, parent, f.basename());
+                     old < nodes.size() && nodes.parent_dir(old) == parent && nodes[old].basename() == f.basename();
+                     old++) {
+                    if (nodes[old].inode() == f.inode() && nodes[old].filetype() == f.filetype()) {
+                        match[id] = old;
+                        break;
+                    }
+                }
+            }
+        });
+        std::vector<char> matched(nodes.size(), 0);
+        std::vector<node_id> resized, retimed;
+        node_store inserted;
+        for (node_id id = 0; id < fresh.size(); id++) {
+            const auto f = fresh[id];
+            const node_id old = match[id];
+            if (old != no_node && !matched[old]) {
+                matched[old] = 1;
+                if (nodes[old].kilobyte() != f.kilobyte() || nodes[old].atime() != f.atime()) {
+                    // only the changed column is written, the other one stays shared with the previous version
+                    if (nodes[old].kilobyte() != f.kilobyte()) {
+                        nodes.set_kilobyte(old, f.kilobyte());
+                        resized.push_back(old);
+                    }
+                    if (nodes[old].atime() != f.atime()) {
+                        nodes.set_atime(old, f.atime());
+                        retimed.push_back(old);
+                    }
+                    stats.modified++;
+                }
+            } else {
+                inserted.add(f.kilobyte(), f.inode(), f.atime(), f.filetype(), parent_of(id), f.basename());
+            }
+        }
+        fresh = node_store();
+
+        // only the entries in the listed directories can be deleted
+        std::vector<char> is_deleted(nodes.size(), 0);
+        std::vector<node_id> deleted, below;
+        auto delete_unmatched = [&](node_id id) {
+            if (matched[id] || is_deleted[id]) {
+                return;
+            }
+            below.push_back(id);
+            while (!below.empty()) {
+                const node_id gone = below.back();
+                below.pop_back();
+                is_deleted[gone] = 1;
+                deleted.push_back(gone);
+                for (node_id child : nodes.children(gone)) {
+                    if (!matched[child] && !is_deleted[child]) {
+                        below.push_back(child);
+                    }
+                }
+            }
+        };
+        if (!dirs) {
+            for (node_id id = 0; id < nodes.size(); id++) {
+                delete_unmatched(id);
+            }
+        }
+        for (dir_id dir : listed) {
+            const node_id entry = nodes.dirs().node(dir);
+            if (entry != no_node) {
+                for (node_id child : nodes.children(entry)) {
+                    delete_unmatched(child);
+                }
+            } else {
+                for (node_id root : nodes.roots()) {
+                    if (nodes.parent_dir(root) == dir) {
+                        delete_unmatched(root);
+                    }
+                }
+            }
+        }
+        std::sort(deleted.begin(), deleted.end());
+        stats.deleted = deleted.size();
+        stats.inserted = inserted.size();
+        stats.unchanged = nodes.size() - stats.deleted - stats.modified;
+
+        // the closest remaining ancestor of a deleted entry has to be hashed again
+        std::vector<node_id> changed;
+        for (node_id id : deleted) {
+            node_id parent = nodes.parent_node(id);
+            while (parent != no_node && is_deleted[parent]) {
+                parent = nodes.parent_node(parent);
+            }
+            if (parent != no_node) {
+                changed.push_back(parent);
+            }
+        }
+        stats.compare_seconds = lap();
+
+        id_remap remap = id_remap::identity(nodes.size());
+        if (!inserted.empty() || !deleted.empty()) {
+            inserted.sort_by_basename();
+            std::vector<node_id> relinked;
+            remap = nodes.merge_sorted(deleted, inserted, relinked);
+            for (auto &id : changed) {
+                id = remap(id);
+            }
+            changed.insert(changed.end(), relinked.begin(), relinked.end());
+            // basenames that still have entries keep their posting lists, only new ones are tokenized
+            std::vector<size_t> run_remap, added_runs;
+            basenames.update(nodes, remap, run_remap, added_runs);
+            extensions.update(nodes, basenames, run_remap, added_runs);
+            trigrams.update(nodes, basenames, run_remap, added_runs);
+            stats.new_basenames = added_runs.size();
+        }
+        // modified entries were matched, so none of them is deleted
+        for (auto &id : resized) {
+            id = remap(id);
+        }
+        for (auto &id : retimed) {
+            id = remap(id);
+        }
+
+        // entries that kept their sort key keep their relative order with their new ids, the others are
+        // sorted and merged in together with the inserted entries
+        const std::vector<node_id> now = remap.renumbers() ? remap.table() : std::vector<node_id>();
+        auto reorder = [&](column<node_id> &order, const std::vector<node_id> &rekeyed, auto less) {
+            std::vector<char> is_rekeyed(nodes.size(), 0);
+            for (node_id id : rekeyed) {
+                is_rekeyed[id] = 1;
+            }
+            std::vector<node_id> resorted(rekeyed);
+            resorted.insert(resorted.end(), remap.inserted().begin(), remap.inserted().end());
+            std::sort(resorted.begin(), resorted.end(), less);
+            column<node_id> merged;
+            merged.resize(nodes.size());
+            node_id *out = merged.data();
+            auto next = resorted.begin();
+            for (node_id old : std::as_const(order)) {
+                const node_id id = now.empty() ? old : now[old];
+                if (id == no_node || is_rekeyed[id]) {
+                    continue;
+                }
+                for (; next != resorted.end() && less(*next, id); ++next) {
+                    *out++ = *next;
+                }
+                *out++ = id;
+            }
+            std::copy(next, resorted.end(), out);
+            order.swap(merged);
+        };
+        if (remap.renumbers() || !resized.empty()) {
+            reorder(nodes_by_size, resized, [this](node_id id1, node_id id2) { return larger_first(nodes, id1, id2); });
+        }
+        if (remap.renumbers() || !retimed.empty()) {
+            reorder(nodes_by_atime, retimed, [this](node_id id1, node_id id2) { return newer_first(nodes, id1, id2); });
+        }
+        times.update(nodes, remap, retimed);
+        stats.merge_seconds = lap();
+
+        changed.insert(changed.end(), resized.begin(), resized.end());
+        changed.insert(changed.end(), remap.inserted().begin(), remap.inserted().end());
+        const auto hashed = rehash_paths(nodes, changed);
+        stats.hashed = hashed.size();
+        // groups refer to ids, and otherwise only change with a tree hash
+        if (remap.renumbers() || !hashed.empty()) {
+            dupes.update(nodes, remap, hashed);
+        }
+        stats.hash_seconds = lap();
+        return stats;
+    }
+
+    void save(snapshot_writer &writer) const
+    {
+        nodes.save(writer);
+        writer.add("nodes_by_size", nodes_by_size);
+        writer.add("nodes_by_atime", nodes_by_atime);
+        times.save(writer);
+        basenames.save(writer);
+        extensions.save(writer);
+        trigrams.save(writer);
+        dupes.save(writer);
+    }
+
+    void load(const snapshot_reader &reader)
+    {
+        nodes.load(reader);
+        reader.load("nodes_by_size", nodes_by_size);
+        reader.load("nodes_by_atime", nodes_by_atime);
+        times.load(reader);
+        basenames.load(reader);
+        extensions.load(reader);
+        trigrams.load(reader);
+        dupes.load(reader);
+    }
+};
@@ -0,0 +1,769 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <mutex>
+#include <string_view>
+#include <charconv>
+#include <exception>
+#include <stdexcept>
+
+#include "indexer.h"
+#include "mapped_file.h"
+#include "basename_dictionary.h"
+#include "trigram_index.h"
+#include "dupe_groups.h"
+#include "tree_hash.h"
+#include "crawler.h"
+#include "bounded_queue.h"
+#include "stream_compression.h"
+
+using namespace std;
+
+size_t resident_memory_kilobyte() {
+    ifstream status("/proc/self/status");
+    for (string line; getline(status, line);) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return static_cast<size_t>(atoll(line.c_str() + 6));
+        }
+    }
+    return 0;
+}
+
+indexer::indexer(std::string filename, std::string name)
+    : filename_(std::move(filename)), name_(name.empty() ? filename_ : std::move(name)),
+      snapshot_filename_(filename_ + ".snapshot"), content(filename_ + ".hashes") {
+
+}
+
+indexer::~indexer() {
+    if (watcher_) {
+        watcher_->stop();
+        watch_thread_.join();
+    }
+    if (content_thread_.joinable()) {
+        content_thread_.join();
+    }
+}
+
+void indexer::start_content_dupes() {
+    content_version_ = current();
+    content_thread_ = std::thread([this] {
+        cout << "finding duplicate file contents in the background..\n";
+        timer s;
+        try {
+            for (const auto &stage : content.find(content_version_->nodes)) {
+                cout << "  " << stage.name << ": " << stage.files_in << " -> " << stage.files_out << " files, "
+                     << stage.bytes_read / 1024 / 1024 << " MiB read, elapsed seconds: " << stage.seconds << endl;
+            }
+        } catch (const std::exception &e) {
+            cout << "finding duplicate file contents failed: " << e.what() << endl;
+        }
+        cout << "duplicate file contents: " << (content.groups() ? content.groups()->size() : 0)
+             << " groups, cached hashes: " << content.cached_hashes() << endl;
+        cout << "elapsed seconds: " << s.stop() << endl;
+    });
+}
+
+void indexer::run() {
+    phases_.clear();
+    const auto input = fingerprint(filename_);
+    bool loaded = false, stale = false;
+    next_ = std::make_shared<index_version>();
+    phase("load_snapshot", [&] { loaded = load_snapshot(input, stale); });
+    if (loaded) {
+        if (stale) {
+            phase("update_nodes", [this] { update_nodes(); });
+            phase("save_snapshot", [&] { save_snapshot(input); });
+        }
+    } else {
+        phase("read_nodes_and_sort", [this] { read_nodes_and_sort(); });
+        phase("create_lookup_tables_and_sort", [this] { create_lookup_tables_and_sort(); });
+        phase("create_substring_index", [this] { create_substring_index(); });
+        phase("create_tree_structure", [this] { create_tree_structure(); });
+        phase("create_hashes_on_tree", [this] { create_hashes_on_tree(); });
+        phase("save_snapshot", [&] { save_snapshot(input); });
+    }
+    input_ = input;
+    publish();
+}
+
+void indexer::reload() {
+    std::lock_guard<std::mutex> updating(update_mutex_);
+    if (crawled_) {
+        throw std::runtime_error("crawled directories are kept current with --watch, not reloaded");
+    }
+    const auto input = fingerprint(filename_);
+    if (input == input_) {
+        cout << filename_ << " did not change, nothing to reload" << endl;
+        return;
+    }
+    cout << "reloading " << filename_ << "..\n";
+    phases_.clear();
+    next_ = std::make_shared<index_version>(*current());
+    phase("update_nodes", [this] { update_nodes(); });
+    phase("save_snapshot", [&] { save_snapshot(input); });
+    input_ = input;
+    publish();
+}
+
+void indexer::run_crawl(const vector<string> &roots) {
+    phases_.clear();
+    crawled_ = true;
+    next_ = std::make_shared<index_version>();
+    phase("crawl_nodes_and_sort", [&] { crawl_nodes_and_sort(roots); });
+    phase("create_lookup_tables_and_sort", [this] { create_lookup_tables_and_sort(); });
+    phase("create_substring_index", [this] { create_substring_index(); });
+    phase("create_tree_structure", [this] { create_tree_structure(); });
+    phase("create_hashes_on_tree", [this] { create_hashes_on_tree(); });
+    publish();
+}
+
+void indexer::publish() {
+    std::atomic_store(&current_, std::shared_ptr<const index_version>(std::move(next_)));
+    results_.clear();
+    static counter &published = default_metrics().add_counter(
+        "indexer_index_versions_published_total", "Index versions published, the first one and every update");
+    published.add();
+    if (on_publish_) {
+        on_publish_();
+    }
+}
+
+std::shared_ptr<const cached_matches> indexer::match(const std::shared_ptr<const index_version> &index,
+                                                     const string &term, const query_context &query) {
+    const string key = result_cache::key("/match", term);
+    if (auto cached = results_.get(key, index)) {
+        return cached;
+    }
+    auto matches = std::make_shared<cached_matches>();
+    // typing sends every prefix of a term, the matches of the longest one still cached contain all of these
+    for (size_t length = term.size(); length-- > 3;) {
+        const auto shorter = results_.peek(result_cache::key("/match", term.substr(0, length)), index);
+        if (shorter && shorter->complete) {
+            static counter &scanned = default_metrics().add_counter(
+                "indexer_scan_bytes_total", "Bytes of basenames scanned by substring searches",
+                metric_label("scan", "refine"));
+            size_t bytes = 0, scanned_ids = 0;
+            for (node_id id : shorter->ids) {
+                // by ids scanned, not matched: a scan that stops matching has to notice cancellation too
+                if ((scanned_ids++ & 4095) == 0 && query.cancelled()) {
+                    matches->complete = false;
+                    scanned.add(bytes);
+                    return matches;
+                }
+                const auto basename = index->nodes[id].basename();
+                bytes += basename.size();
+                if (basename.find(term) != string_view::npos) {
+                    matches->ids.push_back(id);
+                }
+            }
+            scanned.add(bytes);
+            matches->ids.shrink_to_fit();
+            results_.count_refinement();
+            results_.put(key, index, matches);
+            return matches;
+        }
+    }
+    bool cancelled = false;
+    index->trigrams.find(index->nodes, index->basenames, term, [&](node_id first, node_id last) {
+        if (matches->ids.size() + (last - first) > results_.max_matches() || (cancelled = query.cancelled())) {
+            matches->complete = false;
+            return false;
+        }
+        for (node_id id = first; id < last; id++) {
+            matches->ids.push_back(id);
+        }
+        return true;
+    });
+    if (!matches->complete) {
+        matches->ids = vector<node_id>();
+    }
+    if (!cancelled) {
+        matches->ids.shrink_to_fit();
+        results_.put(key, index, matches);
+    }
+    return matches;
+}
+
+// a stale snapshot is loaded anyway, update_nodes() then patches in the differences with the index file
+bool indexer::load_snapshot(const snapshot_input &input, bool &stale) {
+    cout << "loading snapshot " << snapshot_filename_ << "..\n";
+    timer s;
+    try {
+        snapshot_reader reader(snapshot_filename_);
+        if (reader.header().version != snapshot_version) {
+            cout << "snapshot has version " << reader.header().version << ", expected " << snapshot_version << endl;
+            return false;
+        }
+        stale = !(reader.header().input == input);
+        if (stale) {
+            cout << "snapshot is stale, " << filename_ << " changed" << endl;
+        }
+        next_->load(reader);
+    } catch (const std::exception &e) {
+        cout << "no usable snapshot: " << e.what() << endl;
+        next_ = std::make_shared<index_version>();
+        return false;
+    }
+    cout << "entries: " << next_->nodes.size() << endl;
+    cout << "elapsed seconds: " << s.stop() << endl;
+    return true;
+}
+
+void indexer::save_snapshot(const snapshot_input &input) const {
+    cout << "writing snapshot " << snapshot_filename_ << "..\n";
+    timer s;
+    try {
+        snapshot_writer writer(snapshot_filename_, input);
+        next_->save(writer);
+        writer.commit();
+    } catch (const std::exception &e) {
+        cout << "could not write snapshot: " << e.what() << endl;
+        return;
+    }
+    cout << "elapsed seconds: " << s.stop() << endl;
+}
+
+void indexer::print_memory_usage() const {
+    const auto index = current();
+    cout << "memory usage (MiB):" << endl;
+    cout << "  nodes:         " << index->nodes.memory_usage() / 1024 / 1024
+         << " (of which basename arena: " << index->nodes.arena_bytes() / 1024 / 1024
+         << ", directories: " << index->nodes.dirs().memory_usage() / 1024 / 1024 << ")" << endl;
+    cout << "  basenames:     " << index->basenames.memory_usage() / 1024 / 1024 << endl;
+    cout << "  extensions:    " << index->extensions.memory_usage() / 1024 / 1024 << endl;
+    cout << "  dupes:         " << index->dupes.memory_usage() / 1024 / 1024 << endl;
+    cout << "  nodes_by_size: " << index->nodes_by_size.heap_bytes() / 1024 / 1024 << endl;
+    cout << "  by_atime:      " << (index->nodes_by_atime.heap_bytes() + index->times.memory_usage()) / 1024 / 1024
+         << endl;
+    cout << "  trigrams:      " << index->trigrams.memory_usage() / 1024 / 1024 << endl;
+    cout << "  resident:      " << resident_memory_kilobyte() / 1024 << endl;
+}
+
+// parses "%k\t%i\t%A+\t%Y\t%p" lines into result, fields are read in place without intermediate copies
+static void parse_chunk(string_view chunk, node_store &result)
+{
+    // most entries share their directory with an earlier one, resolve each distinct directory only once
+    unordered_map<string_view, dir_id> dir_cache;
+    while (!chunk.empty()) {
+        size_t eol = chunk.find('\n');
+        string_view line = chunk.substr(0, eol);
+        chunk.remove_prefix(eol == string_view::npos ? chunk.size() : eol + 1);
+        if (line.empty()) {
+            continue;
+        }
+        string_view fields[4];
+        for (auto &field : fields) {
+            size_t tab = line.find('\t');
+            if (tab == string_view::npos) {
+                break;
+            }
+            field = line.substr(0, tab);
+            line.remove_prefix(tab + 1);
+        }
+        size_t kilobyte = 0;
+        uint64_t inode = 0;
+        from_chars(fields[0].data(), fields[0].data() + fields[0].size(), kilobyte);
+        from_chars(fields[1].data(), fields[1].data() + fields[1].size(), inode);
+        string_view dir, name;
+        dir_id parent = no_dir;
+        if (split_path(line, dir, name)) {
+            auto iter = dir_cache.find(dir);
+            if (iter == dir_cache.end()) {
+                iter = dir_cache.emplace(dir, result.dirs().intern_path(dir)).first;
+            }
+            parent = iter->second;
+        }
+        result.add(kilobyte, inode, parse_timestamp(fields[2]), fields[3].empty() ? 0 : fields[3][0], parent, name);
+    }
+}
+
+// splits the input in roughly equal parts, each part ending on a newline boundary
+static vector<string_view> split_chunks(string_view input, size_t num_chunks)
+{
+    vector<string_view> chunks;
+    const size_t chunk_size = input.size() / num_chunks + 1;
+    while (!input.empty()) {
+        size_t eol = chunk_size < input.size() ? input.find('\n', chunk_size) : string_view::npos;
+        size_t len = eol == string_view::npos ? input.size() : eol + 1;
+        chunks.push_back(input.substr(0, len));
+        input.remove_prefix(len);
+    }
+    return chunks;
+}
+
+// Reads a compressed index file in a pipeline: one thread decompresses blocks of whole lines, the others
+// parse them as they come, each into a store of its own. The queue between them holds a few blocks, so
+// memory stays bounded however large the file is, and how long each side waited on it shows which of
+// them limits the throughput.
+static vector<node_store> read_compressed_nodes(string_view input, stream_compression compression,
+                                                size_t &arena_bytes)
+{
+    static constexpr size_t block_size = 4 * 1024 * 1024;
+    const size_t num_parsers = max(2u, std::thread::hardware_concurrency()) - 1;
+    bounded_queue<string> blocks(2 * num_parsers);
+    vector<node_store> parsed(num_parsers);
+    vector<double> parse_seconds(num_parsers);
+    size_t decompressed = 0, num_blocks = 0;
+    double decompress_seconds = 0;
+    std::exception_ptr error;
+
+    std::thread decompress([&] {
+        try {
+            timer busy;
+            stream_decompressor decompressor(compression);
+            size_t used = 0;
+            string carry; // the start of a line the previous block ended in
+            for (bool last = false; !last;) {
+                string block = move(carry);
+                const size_t want = block.size() + block_size;
+                used += decompressor.decompress(input.substr(used), block, want);
+                // short of want, the stream is done or the input ran out
+                last = block.size() < want;
+                if (last && !decompressor.at_end()) {
+                    throw std::runtime_error(string(compression_name(compression)) + " input ends in the middle of the stream");
+                }
+                const size_t eol = last ? string::npos : block.rfind('\n');
+                if (eol != string::npos) {
+                    carry = block.substr(eol + 1);
+                    block.resize(eol + 1);
+                }
+                decompressed += block.size();
+                num_blocks++;
+                blocks.push(move(block));
+            }
+            decompress_seconds = busy.stop();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        blocks.close();
+    });
+    vector<std::thread> parsers;
+    for (size_t i = 0; i < num_parsers; i++) {
+        parsers.emplace_back([&, i] {
+            while (auto block = blocks.pop()) {
+                timer busy;
+                parse_chunk(*block, parsed[i]);
+                parse_seconds[i] += busy.stop();
+            }
+        });
+    }
+    decompress.join();
+    for (auto &thread : parsers) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    double parsing = 0;
+    for (double seconds : parse_seconds) {
+        parsing += seconds;
+    }
+    const double mib = decompressed / 1024.0 / 1024.0;
+    const double decompressing = decompress_seconds - blocks.push_wait_seconds();
+    cout << "  decompress (" << compression_name(compression) << "): " << (input.size() / 1024 / 1024) << " MiB to "
+         << static_cast<size_t>(mib) << " MiB in " << num_blocks << " blocks, " << decompressing << " seconds ("
+         << static_cast<size_t>(decompressing > 0 ? mib / decompressing : 0) << " MiB/s), waited "
+         << blocks.push_wait_seconds() << " seconds for the parsers" << endl;
+    cout << "  parse: " << num_parsers << " threads, " << parsing << " seconds ("
+         << static_cast<size_t>(parsing > 0 ? mib / parsing * num_parsers : 0) << " MiB/s together), waited "
+         << blocks.pop_wait_seconds() / num_parsers << " seconds each for input" << endl;
+    arena_bytes = decompressed;
+    return parsed;
+}
+
+vector<node_store> indexer::read_nodes(size_t &arena_bytes) {
+    cout << "reading index file... ";
+    timer s;
+    mapped_file input(filename_);
+    input.advise(MADV_SEQUENTIAL);
+    const auto compression = compression_of(input.view());
+    if (compression != stream_compression::none) {
+        cout << endl;
+        auto parsed = read_compressed_nodes(input.view(), compression, arena_bytes);
+        size_t counter = 0;
+        for (const auto &part : parsed) {
+            counter += part.size();
+        }
+        cout << "lines read: " << counter << endl;
+        cout << "elapsed seconds: " << s.stop() << endl;
+        return parsed;
+    }
+    const size_t num_threads = max(1u, std::thread::hardware_concurrency());
+    const auto chunks = split_chunks(input.view(), num_threads);
+    vector<node_store> parsed(chunks.size());
+    vector<std::thread> threads;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        threads.emplace_back([&, i]() {
+            parse_chunk(chunks[i], parsed[i]);
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    size_t counter = 0;
+    for (const auto &chunk : parsed) {
+        counter += chunk.size();
+    }
+    cout << "lines read: " << counter << " (" << (input.size() / 1024 / 1024) << " MiB in " << chunks.size()
+         << " chunks)" << endl;
+    cout << "elapsed seconds: " << s.stop() << endl;
+    arena_bytes = input.size();
+    return parsed;
+}
+
+void indexer::read_nodes_and_sort() {
+    size_t arena_bytes = 0;
+    auto parsed = read_nodes(arena_bytes);
+    merge_and_sort(parsed, arena_bytes);
+}
+
+static void print_update_stats(const index_update_stats &stats)
+{
+    cout << "unchanged: " << stats.unchanged << ", modified: " << stats.modified << ", inserted: " << stats.inserted
+         << ", deleted: " << stats.deleted << ", new basenames: " << stats.new_basenames << endl;
+    cout << "  compare: " << stats.compare_seconds << ", merge: " << stats.merge_seconds << ", hash "
+         << stats.hashed << " entries: " << stats.hash_seconds << " seconds" << endl;
+}
+
+// patches the loaded snapshot with the changes in the index file, see index_version::update()
+void indexer::update_nodes() {
+    size_t arena_bytes = 0;
+    auto parsed = read_nodes(arena_bytes);
+    node_store fresh;
+    size_t counter = 0;
+    for (const auto &part : parsed) {
+        counter += part.size();
+    }
+    fresh.reserve(counter, arena_bytes);
+    for (auto &part : parsed) {
+        fresh.append(move(part));
+    }
+    cout << "updating the snapshot..\n";
+    timer s;
+    print_update_stats(next_->update(move(fresh)));
+    cout << "duplicate groups: " << next_->dupes.size() << endl;
+    cout << "elapsed seconds: " << s.stop() << endl;
+}
+
+static thread_pool &crawl_pool()
+{
+    // crawling waits on the file system most of the time, so use more threads than cores
+    static thread_pool pool(max(16u, 4 * std::thread::hardware_concurrency()));
+    return pool;
+}
+
+static void print_crawl_stats(const vector<crawl_root_stats> &stats)
+{
+    for (const auto &root : stats) {
+        cout << "  " << root.root << ": " << root.entries << " entries, " << root.errors << " errors, elapsed seconds: "
+             << root.seconds << " (" << static_cast<size_t>(root.seconds > 0 ? root.entries / root.seconds : 0)
+             << " entries/s)" << endl;
+    }
+}
+
+void indexer::crawl_nodes_and_sort(const vector<string> &roots) {
+    cout << "crawling " << roots.size() << " roots..\n";
+    timer s;
+    // entries arrive from all pool threads, spread them over a few independently locked stores
+    vector<node_store> parts(crawl_pool().size());
+    vector<std::mutex> locks(parts.size());
+    std::atomic<size_t> arena_bytes{0};
+    const auto stats = crawler(crawl_pool()).crawl(roots, [&](string_view dir, const vector<crawl_entry> &entries) {
+        const size_t part = std::hash<std::thread::id>()(std::this_thread::get_id()) % parts.size();
+        std::lock_guard<std::mutex> lock(locks[part]);
+        const dir_id parent = parts[part].dirs().intern_path(dir);
+        for (const auto &entry : entries) {
+            parts[part].add(entry.kilobyte, entry.inode, entry.atime, entry.filetype, parent, entry.name);
+            arena_bytes += entry.name.size();
+        }
+    });
+    print_crawl_stats(stats);
+    cout << "elapsed seconds: " << s.stop() << endl;
+    merge_and_sort(parts, arena_bytes);
+}
+
+void indexer::merge_and_sort(vector<node_store> &parts, size_t arena_bytes) {
+    cout << "merging chunks..\n";
+    timer s1;
+    size_t counter = 0;
+    for (const auto &part : parts) {
+        counter += part.size();
+    }
+    next_->nodes.reserve(counter, arena_bytes);
+    for (auto &part : parts) {
+        next_->nodes.append(move(part));
+    }
+    cout << "elapsed seconds: " << s1.stop() << endl;
+    cout << "sorting files in memory..\n";
+    timer s2;
+    next_->nodes.sort_by_basename();
+    cout << "elapsed seconds: " << s2.stop() << endl;
+}
+
+// One thread writes the output, compressing it if its name ends in .gz or .zst, while the crawl threads
+// format the lines; a bounded queue between them holds the batches the writer did not get to yet.
+int write_crawl(const vector<string> &roots, const string &output)
+{
+    cout << "crawling " << roots.size() << " roots into " << output << "..\n";
+    timer s;
+    const auto compression = compression_for(output);
+    FILE *out = fopen(output.c_str(), "w");
+    if (!out) {
+        cerr << "cannot write " << output << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    bounded_queue<string> batches(1024);
+    size_t written = 0;
+    double write_seconds = 0;
+    string error;
+    std::thread writer([&] {
+        try {
+            std::unique_ptr<stream_compressor> compressor;
+            if (compression != stream_compression::none) {
+                compressor.reset(new stream_compressor(compression, out));
+            }
+            while (auto lines = batches.pop()) {
+                timer busy;
+                if (compressor) {
+                    compressor->write(*lines);
+                } else if (fwrite(lines->data(), 1, lines->size(), out) != lines->size()) {
+                    throw std::runtime_error(strerror(errno));
+                }
+                written += lines->size();
+                write_seconds += busy.stop();
+            }
+            if (compressor) {
+                compressor->finish();
+            }
+        } catch (const std::exception &e) {
+            error = e.what();
+            batches.close(); // the crawl goes on, without waiting for the writer
+        }
+    });
+    const auto stats = crawler(crawl_pool()).crawl(roots, [&](string_view dir, const vector<crawl_entry> &entries) {
+        string lines;
+        for (const auto &entry : entries) {
+            char number[24];
+            lines.append(number, to_chars(number, number + sizeof(number), entry.kilobyte).ptr - number);
+            lines += '\t';
+            lines.append(number, to_chars(number, number + sizeof(number), entry.inode).ptr - number);
+            lines += '\t';
+            lines += format_timestamp(entry.atime);
+            lines += '\t';
+            lines += entry.filetype;
+            lines += '\t';
+            lines.append(dir);
+            lines += '/';
+            lines.append(entry.name);
+            lines += '\n';
+        }
+        batches.push(move(lines));
+    });
+    batches.close();
+    writer.join();
+    const bool ok = fclose(out) == 0 && error.empty();
+    print_crawl_stats(stats);
+    cout << "  write (" << compression_name(compression) << "): " << (written / 1024 / 1024) << " MiB, "
+         << write_seconds << " seconds, crawl threads waited " << batches.push_wait_seconds() << " seconds for it"
+         << endl;
+    cout << "elapsed seconds: " << s.stop() << endl;
+    if (!ok) {
+        cerr << "cannot write " << output << (error.empty() ? "" : ": " + error) << endl;
+        return 1;
+    }
+    return 0;
+}
+
+void indexer::start_watching(std::chrono::milliseconds delay) {
+    cout << "watching indexed directories for changes..\n";
+    timer s;
+    watcher_.reset(new watcher());
+    for (const auto &node : current()->nodes) {
+        if (node.filetype() == 'd' && !watcher_->watch(node.file()) && watcher_->full()) {
+            cout << "out of inotify watches, raise /proc/sys/fs/inotify/max_user_watches to watch everything" << endl;
+            break;
+        }
+    }
+    cout << "watched directories: " << watcher_->size() << endl;
+    cout << "elapsed seconds: " << s.stop() << endl;
+    watch_thread_ = std::thread([this, delay] {
+        while (true) {
+            const auto batch = watcher_->wait(delay);
+            if (batch.stopped) {
+                break;
+            }
+            if (batch.changed.empty() && !batch.overflow) {
+                continue;
+            }
+            try {
+                apply_changes(batch);
+            } catch (const std::exception &e) {
+                cout << "applying changes failed: " << e.what() << endl;
+            }
+        }
+    });
+}
+
+// Lists the changed directories again and crawls the created ones, then publishes an updated copy of the
+// current version. Once the web server runs only the watch thread and reload() publish, one at a time, so no
+// update gets lost.
+void indexer::apply_changes(const watch_batch &batch) {
+    std::lock_guard<std::mutex> updating(update_mutex_);
+    cout << "applying changes in " << batch.changed.size() << " directories..\n";
+    timer s;
+    next_ = std::make_shared<index_version>(*current());
+    node_store fresh;
+    vector<string> listed;
+    std::mutex lock;
+    auto add = [&](string_view dir, const vector<crawl_entry> &entries) {
+        std::lock_guard<std::mutex> guard(lock);
+        const dir_id parent = fresh.dirs().intern_path(dir);
+        for (const auto &entry : entries) {
+            fresh.add(entry.kilobyte, entry.inode, entry.atime, entry.filetype, parent, entry.name);
+        }
+    };
+    auto below = [](const string &path, const string &dir) {
+        return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+    };
+    if (batch.overflow) {
+        // events were lost, crawl everything again
+        vector<string> roots;
+        const auto index = current();
+        for (node_id id : index->nodes.roots()) {
+            if (index->nodes[id].filetype() == 'd') {
+                roots.push_back(index->nodes[id].file());
+            }
+        }
+        print_crawl_stats(crawler(crawl_pool()).crawl(roots, add));
+    } else {
+        // directories in a created one are crawled with it, created ones sort before what is below them
+        vector<string> created;
+        for (const auto &dir : batch.created) {
+            if (created.empty() || !below(dir, created.back())) {
+                created.push_back(dir);
+            }
+        }
+        auto in_created = [&](const string &dir) {
+            auto iter = std::upper_bound(created.begin(), created.end(), dir);
+            return iter != created.begin() && (*(iter - 1) == dir || below(dir, *(iter - 1)));
+        };
+        for (const auto &dir : batch.changed) {
+            if (!in_created(dir)) {
+                listed.push_back(dir);
+                crawler::list(dir, add);
+            }
+        }
+        for (const auto &root : created) {
+            watcher_->watch(root);
+            const string parent = root.substr(0, root.find_last_of('/'));
+            crawler(crawl_pool()).crawl({root}, [&](string_view dir, const vector<crawl_entry> &entries) {
+                if (dir == parent) {
+                    return; // the root itself, already listed with its parent
+                }
+                for (const auto &entry : entries) {
+                    if (entry.filetype == 'd') {
+                        watcher_->watch(string(dir) + '/' + string(entry.name));
+                    }
+                }
+                add(dir, entries);
+                std::lock_guard<std::mutex> guard(lock);
+                listed.emplace_back(dir);
+            });
+        }
+    }
+    const auto stats = next_->update(move(fresh), batch.overflow ? nullptr : &listed);
+    print_update_stats(stats);
+    publish();
+    cout << "elapsed seconds: " << s.stop() << endl;
+}
+
+void indexer::create_lookup_tables_and_sort()
+{
+    create_basename_table();
+    cout << "creating lookup tables..\n";
+    timer s3;
+    next_->nodes_by_size.reserve(next_->nodes.size());
+    for (const auto &node : next_->nodes) {
+        next_->nodes_by_size.push_back(node.id());
+    }
+    next_->nodes_by_atime = next_->nodes_by_size;
+    next_->times.build(next_->nodes);
+    cout << "elapsed seconds: " << s3.stop() << endl;
+
+
+    cout << "sorting lookup tables..\n";
+    timer s4;
+    std::sort(next_->nodes_by_size.begin(), next_->nodes_by_size.end(), [this](node_id id1, node_id id2) {
+        return larger_first(next_->nodes, id1, id2);
+    });
+    std::sort(next_->nodes_by_atime.begin(), next_->nodes_by_atime.end(), [this](node_id id1, node_id id2) {
+        return newer_first(next_->nodes, id1, id2);
+    });
+    cout << "elapsed seconds: " << s4.stop() << endl;
+}
+
+void indexer::create_substring_index()
+{
+    cout << "creating substring index..\n";
+    timer s;
+    next_->trigrams.build(next_->nodes, next_->basenames);
+    cout << "postings: " << next_->trigrams.num_postings() << endl;
+    cout << "elapsed seconds: " << s.stop() << endl;
+}
+
+void indexer::create_tree_structure()
+{
+    cout << "creating tree structure..\n";
+    timer s3;
+    next_->nodes.link_children();
+    for (node_id id : next_->nodes.roots()) {
+        cout << "Found root node: " << next_->nodes[id].parent_file() << " - " << next_->nodes[id].file() << endl;
+    }
+    cout << "root got childs: " << next_->nodes.roots().size() << endl;
+    cout << "elapsed seconds: " << s3.stop() << endl;
+}
+
+void indexer::create_hashes_on_tree()
+{
+    cout << "creating hashes recursively..\n";
+    timer s5;
+    for (const auto &level : hash_tree(next_->nodes)) {
+        cout << "  depth " << level.depth << ": " << level.nodes << " nodes, elapsed seconds: " << level.seconds << endl;
+    }
+    cout << "elapsed seconds: " << s5.stop() << " (" << default_pool().size() << " threads)" << endl;
+    create_dupe_groups();
+}
+
+void indexer::create_dupe_groups()
+{
+    cout << "grouping duplicate folders..\n";
+    timer s;
+    next_->dupes.build(next_->nodes);
+    cout << "duplicate groups: " << next_->dupes.size() << endl;
+    cout << "elapsed seconds: " << s.stop() << endl;
+}
+
+void indexer::create_basename_table()
+{
+    cout << "creating basename table..\n";
+    timer s;
+    next_->basenames.build(next_->nodes);
+    next_->extensions.build(next_->nodes, next_->basenames);
+    cout << "distinct basenames: " << next_->basenames.size() << ", extensions: " << next_->extensions.size() << endl;
+    cout << "elapsed seconds: " << s.stop() << endl;
+}
@@ -0,0 +1,148 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+#include "node_store.h"
+#include "snapshot.h"
+#include "content_dupes.h"
+#include "index_version.h"
+#include "watcher.h"
+#include "result_cache.h"
+#include "query_context.h"
+#include "metrics.h"
+
+class timer
+{
+private:
+    std::chrono::time_point<std::chrono::system_clock> start_, end_;
+
+public:
+    timer()
+        : start_(std::chrono::system_clock::now()),
+          end_(std::chrono::system_clock::now())
+    {}
+    double stop() {
+        end_ = std::chrono::system_clock::now();
+        std::chrono::duration<double> elapsed_seconds = end_ - start_;
+
+        return elapsed_seconds.count();
+    }
+};
+
+size_t resident_memory_kilobyte();
+
+struct phase_timing
+{
+    std::string name;
+    double seconds;
+};
+
+class indexer
+{
+public: // too lazy right now to make getters
+    std::string filename_;
+    std::string name_; // of the shard, see shard_set
+    std::string snapshot_filename_;
+    content_dupes content;
+    std::thread content_thread_;
+public:
+    explicit indexer(std::string filename, std::string name = "");
+    ~indexer();
+
+    void run();
+
+    // reads the index file again and publishes the changes to the current version, while the current one
+    // keeps being served; does nothing if the file did not change since it was last read. Throws for
+    // indexes of run_crawl().
+    void reload();
+
+    // indexes the given directory trees directly instead of reading an index file
+    void run_crawl(const std::vector<std::string> &roots);
+
+    // compares file contents on a background thread, see content_dupes
+    void start_content_dupes();
+
+    // keeps the index up to date with changes in the indexed directories, in batches collected for delay
+    void start_watching(std::chrono::milliseconds delay);
+
+    // The published version. Requests take it once and keep using it, so they never wait for an update
+    // and never see half of one; a version is freed when the last request using it is done.
+    std::shared_ptr<const index_version> current() const { return std::atomic_load(&current_); }
+
+    // called with every version published from now on, on the thread that published it
+    void on_publish(std::function<void()> callback) { on_publish_ = std::move(callback); }
+
+    // the version duplicate file contents were found in, their node ids refer to it
+    std::shared_ptr<const index_version> content_version() const { return content_version_; }
+
+    // all entries whose basename contains term (at least 3 characters), from the result cache when the
+    // same term or a shorter one was asked for on this version before. Incomplete if query was cancelled.
+    std::shared_ptr<const cached_matches> match(const std::shared_ptr<const index_version> &index,
+                                                const std::string &term, const query_context &query);
+
+    result_cache_stats cache_stats() { return results_.stats(); }
+
+    void print_memory_usage() const;
+
+    // the steps of the last run() or run_crawl() and how long each took
+    const std::vector<phase_timing> &phases() const { return phases_; }
+
+private:
+    std::shared_ptr<index_version> next_; // the version being built or updated
+    std::shared_ptr<const index_version> current_;
+    std::shared_ptr<const index_version> content_version_; // set before the web server starts
+    std::function<void()> on_publish_;
+    std::unique_ptr<watcher> watcher_;
+    std::thread watch_thread_;
+    std::mutex update_mutex_; // held while reload() or the watch thread build and publish a version
+    snapshot_input input_;    // the index file as it was last read
+    bool crawled_ = false;    // by run_crawl(), there is no index file
+    result_cache results_;
+    std::vector<phase_timing> phases_;
+
+    template <typename F>
+    void phase(const char *name, F step)
+    {
+        timer s;
+        step();
+        phases_.push_back({name, s.stop()});
+        default_metrics()
+            .add_gauge("indexer_phase_seconds", "Seconds the steps of the last index build or load took",
+                       metric_label("phase", name) + ',' + metric_label("shard", name_))
+            .set(phases_.back().seconds);
+    }
+
+    void publish();
+    void apply_changes(const watch_batch &batch);
+
+    // the index file, plain or gzip/zstd compressed (see stream_compression.h)
+    std::vector<node_store> read_nodes(size_t &arena_bytes);
+    void read_nodes_and_sort();
+    void update_nodes();
+    void crawl_nodes_and_sort(const std::vector<std::string> &roots);
+    void merge_and_sort(std::vector<node_store> &parts, size_t arena_bytes);
+    void create_lookup_tables_and_sort();
+    void create_substring_index();
+    void create_tree_structure();
+    void create_hashes_on_tree();
+    void create_dupe_groups();
+    void create_basename_table();
+    bool load_snapshot(const snapshot_input &input, bool &stale);
+    void save_snapshot(const snapshot_input &input) const;
+};
+
+// writes the crawled entries in the format of `find -printf "%k\t%i\t%A+\t%Y\t%p\n"`, unsorted, compressed
+// if output ends in .gz or .zst
+int write_crawl(const std::vector<std::string> &roots, const std::string &output);
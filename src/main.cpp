@@ -0,0 +1,239 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <vector>
+#include <string>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include "crow.h"
+#include "indexer.h"
+#include "shard_set.h"
+#include "routes.h"
+#include "coordinator.h"
+
+#include "md5.h"
+
+class webserver
+{
+public:
+    template <typename T>
+    webserver(shard_set &shards, T start_webserver)
+      : webserver_(start_webserver), shards_(shards) {}
+
+    ~webserver()
+    {
+        webserver_.join();
+    }
+
+    std::thread webserver_;
+    shard_set &shards_;
+};
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    bool crawl = argc > 1 && string(argv[1]) == "crawl";
+    bool coordinate = argc > 1 && string(argv[1]) == "coordinate";
+    bool content_dupes = false;
+    bool watch = false;
+    auto deadline = std::chrono::milliseconds(5000);
+    auto peer_timeout = std::chrono::milliseconds(2000);
+    uint16_t port = 8888;
+    string output;
+    vector<string> inputs;
+    for (int i = crawl || coordinate ? 2 : 1; i < argc; i++) {
+        const string arg = argv[i];
+        if (arg == "--content-dupes") {
+            content_dupes = true;
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--deadline" && i + 1 < argc) {
+            deadline = std::chrono::milliseconds(std::stoll(argv[++i]));
+        } else if (arg == "--output" && crawl && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "--peer-timeout" && coordinate && i + 1 < argc) {
+            peer_timeout = std::chrono::milliseconds(std::stoll(argv[++i]));
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        cerr << "Usage " << argv[0] << " [<name>=]<index>... [--content-dupes] [--watch] [--deadline <ms>] [--port <port>]  (one shard per index)" << endl;
+        cerr << "      " << argv[0] << " crawl [--content-dupes] [--watch] [--deadline <ms>] <root>...  (index directories directly)" << endl;
+        cerr << "      " << argv[0] << " crawl --output <index> <root>...  (write an index file)" << endl;
+        cerr << "      " << argv[0] << " coordinate [--port <port>] [--peer-timeout <ms>] <host>[:<port>]...  (query the indexers of other machines)" << endl;
+        return 1;
+    }
+    if (coordinate) {
+        vector<peer> peers;
+        try {
+            for (const auto &input : inputs) {
+                peers.push_back(peer::parse(input));
+            }
+        } catch (const std::invalid_argument &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        const auto index_html = static_asset::load("index.html", "text/html; charset=utf-8");
+        crow::App<> app;
+        add_coordinator_routes(app, peers, peer_timeout, index_html);
+        // a handler thread waits for the peers of one query, the work is theirs
+        app.port(port).concurrency(64).run();
+        return 0;
+    }
+    if (!output.empty()) {
+        return write_crawl(inputs, output);
+    }
+
+    // every index file is a shard of its own, built at the same time and reloaded separately
+    shard_set shards;
+    if (crawl) {
+        shards.add("crawl").run_crawl(inputs);
+    } else {
+        for (const auto &input : inputs) {
+            shards.add_spec(input);
+        }
+        shards.run();
+    }
+    for (size_t s = 0; s < shards.size(); s++) {
+        cout << "shard " << shards[s].name_ << ":\n";
+        shards[s].print_memory_usage();
+        if (content_dupes) {
+            shards[s].start_content_dupes();
+        }
+        if (watch) {
+            shards[s].start_watching(std::chrono::seconds(2));
+        }
+    }
+
+    cout << "listing all duplicate folders > 1GiB..\n";
+    timer s6;
+    {
+        const auto dupes = shards.dupes();
+        const auto &versions = dupes->versions();
+        for (size_t group = 0; group < dupes->count_at_least(1024 * 1024 /* 1 GiB */); group++) {
+            cout << "hash " << dupes->hash(group) << " occurs " << dupes->members(group).size() << " times..." << endl;
+            for (const auto &member : dupes->members(group)) {
+                cout << " to be specific: " << versions[member.shard]->nodes[member.id].file() << endl;
+            }
+        }
+    }
+    cout << "elapsed seconds: " << s6.stop() << endl;
+
+    // read and compressed once, restart to serve a changed index.html
+    const auto index_html = static_asset::load("index.html", "text/html; charset=utf-8");
+
+    // queries of a session are cancelled by its next one, and all of them once they take longer than deadline
+    query_sessions sessions(deadline);
+
+    query_executor executor(max(2u, std::thread::hardware_concurrency()));
+    add_route_limits(executor);
+
+    webserver ws(shards, [&]() -> void {
+        crow::App<> app;
+        add_routes(app, shards, sessions, executor, index_html);
+
+        //crow::logger::setLogLevel(crow::LogLevel::DEBUG);
+
+        // handler threads waiting for scans are bounded by the executor, the ones beyond serve lookups
+        app.port(port)
+            .concurrency(static_cast<uint16_t>(std::min<size_t>(
+                executor.capacity(query_class::scan) + std::thread::hardware_concurrency(), 1024)))
+            .run();
+    });
+
+
+#if 1 == 2
+
+
+//    cout << "Type folder name:" << endl;
+//    MD5 md5;
+//    for (string line; getline(cin, line);) {
+//
+//        if (line.find(" ") == string::npos) {
+//            for (size_t i=0; i< 256; i++) { cout << "\n"; }
+//            cout << "Usage: <command> <param>\n";
+//            cout << "  i.e. find foo (find basename exactly matching foo)\n";
+//            cout << "  i.e. match foo (find basename containing foo)\n";
+//            cout << "  i.e. matchdir foo (find folders containing foo)\n";
+//            cout << "  i.e. by size (display largest file(s) ordered by size DESC))\n";
+//            cout << "Type folder name:" << endl;
+//            continue;
+//        }
+//        auto command = line.substr(0, line.find(" "));
+//        line = line.substr(line.find(" ") + 1);
+//
+//        if (command == "find") {
+//            auto iter = basenames.find(line);
+//            if (iter == basenames.end()) {
+//                cout << "Nothing found. Try using 'match'...\n";
+//            } else {
+//                vector<string> results;
+//                for (; iter!=basenames.begin(); iter++) {
+//                    const auto &node = nodes[iter->second];
+//                    if (node.basename() != line) {
+//                        break;
+//                    }
+//                    results.emplace_back(node.file());
+//                }
+//                sort(results.begin(), results.end());
+//                for (const auto &result : results) {
+//                    cout << result << endl;
+//                }
+//            }
+//        }
+//        else if (command == "match" || command == "matchdir") {
+//            bool only_folders = command == "matchdir";
+//            size_t counter = 0;
+//            cout << "matching " << line << endl;
+//            for (const auto &node : nodes) {
+//                if (node.basename().find(line) != string::npos) {
+//                    if (only_folders && node.filetype() != 'd')
+//                        continue;
+//                    cout << "match: " << node.file() << endl;
+//                    counter++;
+//                    if (counter >= 100) {
+//                        cout << "Enough matches, cancelling..\n";
+//                        break;
+//                    }
+//                }
+//            }
+//        }
+//        else if (command == "by" /* by size ;'-) */) {
+//            size_t counter = 0;
+//            cout << "matching " << line << endl;
+//            for (const auto &p : nodes_by_size) {
+//                const auto & KiB = p.first;
+//                const auto & node = *p.second;
+//                cout << "match: " << (node.kilobyte() / 1024) << "MiB " << node.file() << endl;
+//                counter++;
+//                if (counter >= 100) {
+//                    cout << "Enough matches, cancelling..\n";
+//                    break;
+//                }
+//            }
+//        }
+//        else if (command == "calc" /* md5 */) {
+//            for (const auto &node : nodes) {
+//                if (node.filetype() != 'd') {
+//                    cout << md5.digestFile( (char *)node.file().c_str() )  << endl;
+//                }
+//            }
+//        }
+//        cout << "Type folder name:" << endl;
+//    }
+
+#endif
+
+    cout << "Freeing memory..\n";
+    return 0;
+}
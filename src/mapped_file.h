@@ -0,0 +1,77 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// memory mapping of a whole file, pages are faulted in on first access. A copy-on-write mapping can be
+// modified in memory without ever touching the file.
+class mapped_file
+{
+private:
+    int fd_ = -1;
+    void *data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit mapped_file(const std::string &filename, bool copy_on_write = false)
+    {
+        fd_ = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ == -1) {
+            throw std::runtime_error("cannot open " + filename + ": " + strerror(errno));
+        }
+        struct stat st{};
+        if (::fstat(fd_, &st) == -1) {
+            ::close(fd_);
+            throw std::runtime_error("cannot stat " + filename + ": " + strerror(errno));
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            return; // mmap() refuses zero length mappings
+        }
+        data_ = ::mmap(nullptr, size_, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (data_ == MAP_FAILED) {
+            data_ = nullptr;
+            ::close(fd_);
+            throw std::runtime_error("cannot mmap " + filename + ": " + strerror(errno));
+        }
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    ~mapped_file()
+    {
+        if (data_) {
+            ::munmap(data_, size_);
+        }
+        if (fd_ != -1) {
+            ::close(fd_);
+        }
+    }
+
+    // hint the kernel about the upcoming access pattern (MADV_SEQUENTIAL, MADV_WILLNEED, ..)
+    void advise(int advice) const
+    {
+        if (data_) {
+            ::madvise(data_, size_, advice);
+        }
+    }
+
+    const char *data() const { return static_cast<const char *>(data_); }
+    char *mutable_data() { return static_cast<char *>(data_); }
+    size_t size() const { return size_; }
+    std::string_view view() const { return {data(), size_}; }
+};
@@ -0,0 +1,263 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstdio>
+
+// Counters, gauges and histograms for monitoring, rendered in the Prometheus text format for /metrics.
+// Recording a value is a relaxed atomic add without locks; only registering a series and rendering take
+// the registry's lock, so series are looked up once and kept by reference on hot paths.
+
+// each thread adds to its own slot, so threads counting the same thing do not share a cache line
+inline size_t metrics_thread_slot()
+{
+    static std::atomic<size_t> next_slot{0};
+    thread_local const size_t slot = next_slot++;
+    return slot;
+}
+
+class counter
+{
+private:
+    static constexpr size_t num_slots = 16;
+
+    struct alignas(64) slot
+    {
+        std::atomic<uint64_t> value{0};
+    };
+
+    slot slots_[num_slots];
+
+public:
+    void add(uint64_t n = 1) { slots_[metrics_thread_slot() % num_slots].value.fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t value() const
+    {
+        uint64_t total = 0;
+        for (const auto &s : slots_) {
+            total += s.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+class gauge
+{
+private:
+    std::atomic<double> value_{0};
+
+public:
+    void set(double value) { value_.store(value, std::memory_order_relaxed); }
+
+    double value() const { return value_.load(std::memory_order_relaxed); }
+};
+
+// Bucket i counts the observations <= 2^i units, e.g. microseconds for latencies; the unit is what one of
+// them is in the base unit Prometheus expects (seconds, bytes, ..).
+class histogram
+{
+private:
+    static constexpr size_t max_buckets = 40;
+
+    double unit_;
+    size_t num_buckets_;
+    std::atomic<uint64_t> buckets_[max_buckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+
+public:
+    histogram(double unit, size_t num_buckets) : unit_(unit), num_buckets_(std::min(num_buckets, max_buckets)) {}
+
+    void observe(uint64_t value)
+    {
+        size_t bucket = value <= 1 ? 0 : 64 - __builtin_clzll(value - 1);
+        buckets_[std::min(bucket, num_buckets_ - 1)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    double unit() const { return unit_; }
+    size_t num_buckets() const { return num_buckets_; }
+    // the last bucket also counts everything above its bound
+    uint64_t bucket(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+};
+
+// a label for a series, e.g. metric_label("route", "/find"); labels of a series are joined with ','
+inline std::string metric_label(std::string_view name, std::string_view value)
+{
+    std::string label(name);
+    label += "=\"";
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            label += '\\';
+            label += c;
+        } else if (c == '\n') {
+            label += "\\n";
+        } else {
+            label += c;
+        }
+    }
+    label += '"';
+    return label;
+}
+
+class metrics_registry
+{
+private:
+    struct series
+    {
+        std::string labels;
+        std::unique_ptr<counter> counter_;
+        std::unique_ptr<gauge> gauge_;
+        std::unique_ptr<histogram> histogram_;
+        std::function<double()> read; // for values read when rendering
+    };
+
+    struct family
+    {
+        std::string help;
+        const char *type;
+        std::vector<std::unique_ptr<series>> series_;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, family> families_; // by name, rendered in name order
+
+    series &find_or_add(const std::string &name, const std::string &help, const char *type, const std::string &labels)
+    {
+        auto &f = families_[name];
+        if (f.help.empty()) {
+            f.help = help;
+            f.type = type;
+        }
+        for (auto &s : f.series_) {
+            if (s->labels == labels) {
+                return *s;
+            }
+        }
+        f.series_.emplace_back(new series{labels, {}, {}, {}, {}});
+        return *f.series_.back();
+    }
+
+    static void append_number(std::string &out, double value)
+    {
+        char number[32];
+        snprintf(number, sizeof(number), "%.15g", value);
+        out += number;
+    }
+
+    static void append_series(std::string &out, const std::string &name, const char *suffix, const std::string &labels,
+                              const std::string &extra_label, double value)
+    {
+        out += name;
+        out += suffix;
+        if (!labels.empty() || !extra_label.empty()) {
+            out += '{';
+            out += labels;
+            out += !labels.empty() && !extra_label.empty() ? "," : "";
+            out += extra_label;
+            out += '}';
+        }
+        out += ' ';
+        append_number(out, value);
+        out += '\n';
+    }
+
+public:
+    // Registering the same name and labels again returns the series registered first, so the references
+    // stay valid for as long as the registry lives.
+    counter &add_counter(const std::string &name, const std::string &help, const std::string &labels = "")
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &s = find_or_add(name, help, "counter", labels);
+        if (!s.counter_) {
+            s.counter_.reset(new counter());
+        }
+        return *s.counter_;
+    }
+
+    gauge &add_gauge(const std::string &name, const std::string &help, const std::string &labels = "")
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &s = find_or_add(name, help, "gauge", labels);
+        if (!s.gauge_) {
+            s.gauge_.reset(new gauge());
+        }
+        return *s.gauge_;
+    }
+
+    histogram &add_histogram(const std::string &name, const std::string &help, double unit, size_t num_buckets,
+                             const std::string &labels = "")
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &s = find_or_add(name, help, "histogram", labels);
+        if (!s.histogram_) {
+            s.histogram_.reset(new histogram(unit, num_buckets));
+        }
+        return *s.histogram_;
+    }
+
+    // A value that already exists elsewhere, read when rendering; type is "counter" or "gauge". Registering
+    // it again replaces read, read must stay callable until then.
+    void add_callback(const std::string &name, const std::string &help, const char *type, const std::string &labels,
+                      std::function<double()> read)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        find_or_add(name, help, type, labels).read = std::move(read);
+    }
+
+    // the Prometheus text exposition format, version 0.0.4
+    std::string render()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out;
+        for (const auto &[name, f] : families_) {
+            out += "# HELP " + name + ' ' + f.help + '\n';
+            out += "# TYPE " + name + ' ' + f.type + '\n';
+            for (const auto &s : f.series_) {
+                if (s->counter_) {
+                    append_series(out, name, "", s->labels, "", s->counter_->value());
+                } else if (s->gauge_) {
+                    append_series(out, name, "", s->labels, "", s->gauge_->value());
+                } else if (s->histogram_) {
+                    const auto &h = *s->histogram_;
+                    uint64_t cumulative = 0;
+                    for (size_t i = 0; i + 1 < h.num_buckets(); i++) {
+                        cumulative += h.bucket(i);
+                        std::string le;
+                        append_number(le, static_cast<double>(uint64_t(1) << i) * h.unit());
+                        append_series(out, name, "_bucket", s->labels, "le=\"" + le + '"', cumulative);
+                    }
+                    append_series(out, name, "_bucket", s->labels, "le=\"+Inf\"", h.count());
+                    append_series(out, name, "_sum", s->labels, "", h.sum() * h.unit());
+                    append_series(out, name, "_count", s->labels, "", h.count());
+                } else if (s->read) {
+                    append_series(out, name, "", s->labels, "", s->read());
+                }
+            }
+        }
+        return out;
+    }
+};
+
+// the registry /metrics renders
+inline metrics_registry &default_metrics()
+{
+    static metrics_registry registry;
+    return registry;
+}
@@ -0,0 +1,100 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <ostream>
+
+// 128-bit hash value, ordered and addable so it can serve as a key and as an order-independent accumulator
+struct hash128
+{
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const hash128 &other) const { return low == other.low && high == other.high; }
+    bool operator!=(const hash128 &other) const { return !(*this == other); }
+    bool operator<(const hash128 &other) const { return high != other.high ? high < other.high : low < other.low; }
+
+    // addition modulo 2^128
+    hash128 &operator+=(const hash128 &other)
+    {
+        low += other.low;
+        high += other.high + (low < other.low);
+        return *this;
+    }
+
+    std::string str() const
+    {
+        char buffer[33];
+        snprintf(buffer, sizeof(buffer), "%016llx%016llx", static_cast<unsigned long long>(high),
+                 static_cast<unsigned long long>(low));
+        return buffer;
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const hash128 &hash) { return os << hash.str(); }
+
+// MurmurHash3_x64_128 by Austin Appleby (public domain), same output as the reference implementation on
+// little-endian machines
+inline hash128 murmur3_128(const void *key, size_t len, uint64_t seed = 0)
+{
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto fmix = [](uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    };
+    const uint8_t *data = static_cast<const uint8_t *>(key);
+    const size_t nblocks = len / 16;
+    uint64_t h1 = seed, h2 = seed;
+    const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+
+    for (size_t i = 0; i < nblocks; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, data + i * 16, 8);
+        memcpy(&k2, data + i * 16 + 8, 8);
+
+        k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const uint8_t *tail = data + nblocks * 16;
+    uint64_t k1 = 0, k2 = 0;
+    switch (len & 15) {
+    case 15: k2 ^= uint64_t(tail[14]) << 48; // fall through
+    case 14: k2 ^= uint64_t(tail[13]) << 40; // fall through
+    case 13: k2 ^= uint64_t(tail[12]) << 32; // fall through
+    case 12: k2 ^= uint64_t(tail[11]) << 24; // fall through
+    case 11: k2 ^= uint64_t(tail[10]) << 16; // fall through
+    case 10: k2 ^= uint64_t(tail[9]) << 8;   // fall through
+    case 9:  k2 ^= uint64_t(tail[8]);
+             k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+             // fall through
+    case 8:  k1 ^= uint64_t(tail[7]) << 56;  // fall through
+    case 7:  k1 ^= uint64_t(tail[6]) << 48;  // fall through
+    case 6:  k1 ^= uint64_t(tail[5]) << 40;  // fall through
+    case 5:  k1 ^= uint64_t(tail[4]) << 32;  // fall through
+    case 4:  k1 ^= uint64_t(tail[3]) << 24;  // fall through
+    case 3:  k1 ^= uint64_t(tail[2]) << 16;  // fall through
+    case 2:  k1 ^= uint64_t(tail[1]) << 8;   // fall through
+    case 1:  k1 ^= uint64_t(tail[0]);
+             k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len; h2 ^= len;
+    h1 += h2; h2 += h1;
+    h1 = fmix(h1); h2 = fmix(h2);
+    h1 += h2; h2 += h1;
+    return {h1, h2};
+}
@@ -0,0 +1,828 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <numeric>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "column.h"
+#include "snapshot.h"
+#include "path_trie.h"
+#include "murmur3.h"
+
+// "%A+" timestamps are kept as nanoseconds since the epoch of the wall clock find printed them in,
+// converting without a timezone makes them round-trip exactly.
+constexpr int64_t no_timestamp = std::numeric_limits<int64_t>::min();
+
+inline int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+inline void civil_from_days(int64_t z, int64_t &y, unsigned &m, unsigned &d)
+{
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+// parses "2019-02-20+01:38:12.1234567890", the fraction may be left out; anything else, like separators
+// in the wrong place or a 31st of April, is no_timestamp
+inline int64_t parse_timestamp(std::string_view s)
+{
+    auto number = [&s](size_t pos, size_t len, int64_t &out) {
+        if (pos + len > s.size() || s[pos] < '0' || s[pos] > '9') {
+            return false;
+        }
+        auto res = std::from_chars(s.data() + pos, s.data() + pos + len, out);
+        return res.ec == std::errc() && res.ptr == s.data() + pos + len;
+    };
+    auto separator = [&s](size_t pos, char c) { return pos < s.size() && s[pos] == c; };
+    int64_t year, month, day, hour, minute, second;
+    if (!number(0, 4, year) || !separator(4, '-') || !number(5, 2, month) || !separator(7, '-') ||
+        !number(8, 2, day) || !separator(10, '+') || !number(11, 2, hour) || !separator(13, ':') ||
+        !number(14, 2, minute) || !separator(16, ':') || !number(17, 2, second) ||
+        (s.size() > 19 && (!separator(19, '.') || s.size() == 20))) {
+        return no_timestamp;
+    }
+    static const int64_t days_in_month[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    const bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    // a second of 60 is a leap second, strftime() prints those
+    if (month < 1 || month > 12 || day < 1 || day > days_in_month[month - 1] || (month == 2 && day == 29 && !leap) ||
+        hour > 23 || minute > 59 || second > 60) {
+        return no_timestamp;
+    }
+    int64_t nanos = 0;
+    size_t digits = 0;
+    for (size_t i = 20; i < s.size(); i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return no_timestamp;
+        }
+        if (digits < 9) { // find prints ten digits, beyond nanoseconds they are always 0
+            nanos = nanos * 10 + (s[i] - '0');
+            digits++;
+        }
+    }
+    for (; digits < 9; digits++) {
+        nanos *= 10;
+    }
+    const int64_t days = days_from_civil(year, static_cast<unsigned>(month), static_cast<unsigned>(day));
+    return ((days * 24 + hour) * 60 + minute) * 60 * 1000000000 + second * 1000000000 + nanos;
+}
+
+inline std::string format_timestamp(int64_t ts)
+{
+    if (ts == no_timestamp) {
+        return {};
+    }
+    const int64_t ns_per_day = int64_t(86400) * 1000000000;
+    int64_t days = ts / ns_per_day;
+    int64_t rest = ts % ns_per_day;
+    if (rest < 0) {
+        rest += ns_per_day;
+        days--;
+    }
+    int64_t y;
+    unsigned m, d;
+    civil_from_days(days, y, m, d);
+    const int64_t seconds = rest / 1000000000;
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%04lld-%02u-%02u+%02lld:%02lld:%02lld.%09lld0", static_cast<long long>(y), m, d,
+             static_cast<long long>(seconds / 3600), static_cast<long long>(seconds / 60 % 60),
+             static_cast<long long>(seconds % 60), static_cast<long long>(rest % 1000000000));
+    return buf;
+}
+
+class node_store;
+
+// lightweight view on one entry of the node_store
+class node
+{
+private:
+    const node_store *store_;
+    node_id id_;
+
+public:
+    node(const node_store &store, node_id id) : store_(&store), id_(id) {}
+
+    node_id id() const { return id_; }
+    size_t kilobyte() const;
+    uint64_t inode() const;
+    char filetype() const;
+    int64_t atime() const;
+    std::string date() const { return format_timestamp(atime()); }
+    // full paths are rebuilt from the interned directories on demand
+    std::string file() const;
+    std::string parent_file() const;
+    std::string_view basename() const;
+    dir_id parent_dir() const;
+    hash128 my_hash() const;
+    size_t cum_kilobyte() const;
+    size_t file_count() const;
+};
+
+inline bool operator<(const node &lhs, const node &rhs) {
+    return lhs.basename() < rhs.basename();
+}
+
+// contiguous range of node ids, i.e. the children of a node
+struct id_range
+{
+    const node_id *first;
+    const node_id *last;
+    const node_id *begin() const { return first; }
+    const node_id *end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+};
+
+// New ids of the entries of a node_store after merge_sorted(): kept entries move in runs, every entry of
+// a run by the same distance, and deleted ones have none. A lookup is a binary search over the runs, so
+// with few changes the remap is small and cheap to apply.
+class id_remap
+{
+public:
+    struct run
+    {
+        node_id old_first;
+        node_id old_last;
+        node_id new_first;
+    };
+
+private:
+    std::vector<run> runs_;         // ascending
+    std::vector<node_id> inserted_; // new ids of the inserted entries, ascending
+    size_t old_size_ = 0;
+    size_t new_size_ = 0;
+
+public:
+    explicit id_remap(size_t old_size = 0) : old_size_(old_size) {}
+
+    // every entry keeps its id
+    static id_remap identity(size_t size)
+    {
+        id_remap remap(size);
+        remap.keep(0, static_cast<node_id>(size));
+        return remap;
+    }
+
+    // the next new ids go to the old entries [old_first, old_last>, or to one inserted entry
+    void keep(node_id old_first, node_id old_last)
+    {
+        if (old_first < old_last) {
+            runs_.push_back({old_first, old_last, static_cast<node_id>(new_size_)});
+            new_size_ += old_last - old_first;
+        }
+    }
+    void insert() { inserted_.push_back(static_cast<node_id>(new_size_++)); }
+
+    bool renumbers() const { return !inserted_.empty() || new_size_ != old_size_; }
+    size_t old_size() const { return old_size_; }
+    size_t new_size() const { return new_size_; }
+    const std::vector<run> &runs() const { return runs_; }
+    const std::vector<node_id> &inserted() const { return inserted_; }
+
+    // new id of old, no_node if it was deleted
+    node_id operator()(node_id old) const
+    {
+        auto iter = std::upper_bound(runs_.begin(), runs_.end(), old,
+                                     [](node_id id, const run &r) { return id < r.old_first; });
+        if (iter == runs_.begin() || old >= (--iter)->old_last) {
+            return no_node;
+        }
+        return iter->new_first + (old - iter->old_first);
+    }
+
+    // new id of the first kept entry at or after old, or new_size()
+    node_id lower_bound(node_id old) const
+    {
+        auto iter = std::upper_bound(runs_.begin(), runs_.end(), old,
+                                     [](node_id id, const run &r) { return id < r.old_last; });
+        if (iter == runs_.end()) {
+            return static_cast<node_id>(new_size_);
+        }
+        return iter->new_first + (std::max(old, iter->old_first) - iter->old_first);
+    }
+
+    // the new id of every old one, for passes that look up all of them in no particular order
+    std::vector<node_id> table() const
+    {
+        std::vector<node_id> now(old_size_, no_node);
+        for (const auto &r : runs_) {
+            for (node_id old = r.old_first; old < r.old_last; old++) {
+                now[old] = r.new_first + (old - r.old_first);
+            }
+        }
+        return now;
+    }
+};
+
+// splits "/a/b/c" in directory "/a/b" and name "c", returns false for paths without a directory
+inline bool split_path(std::string_view file, std::string_view &dir, std::string_view &name)
+{
+    if (file.size() > 1 && file.back() == '/') {
+        file.remove_suffix(1); // "find /mnt/" prints the starting point as "/mnt/"
+    }
+    const size_t slash = file.find_last_of('/');
+    if (slash == std::string_view::npos) {
+        name = file;
+        return false;
+    }
+    dir = file.substr(0, slash);
+    name = file.substr(slash + 1);
+    return true;
+}
+
+// struct-of-arrays storage for all index entries. Only basenames are stored per entry (in one arena),
+// the directories leading up to them are interned in a path_trie.
+class node_store
+{
+private:
+    friend class node;
+
+    column<uint64_t> kilobyte_;
+    column<uint64_t> inode_;
+    column<char> filetype_;
+    column<int64_t> atime_;
+    column<uint64_t> name_offset_;
+    column<uint16_t> name_length_;
+    column<dir_id> parent_dir_;
+    column<hash128> hash_;
+    column<uint64_t> cum_kilobyte_;
+    column<uint64_t> file_count_; // non-directory entries in the subtree, including the entry itself
+    // tree links in CSR form: children of node i are children_[child_offset_[i] .. child_offset_[i + 1]>
+    column<uint32_t> child_offset_;
+    column<node_id> children_;
+    column<node_id> roots_;
+    column<char> arena_;
+    path_trie dirs_;
+
+    template <typename T>
+    static void permute(column<T> &col, const std::vector<node_id> &order)
+    {
+        column<T> sorted;
+        sorted.reserve(col.size());
+        for (node_id id : order) {
+            sorted.push_back(std::as_const(col)[id]);
+        }
+        col.swap(sorted);
+    }
+
+    // visits the runs of kept entries and the inserted entries (by number and new id) in new id order
+    template <typename Run, typename Inserted>
+    static void for_each_in_order(const id_remap &remap, Run on_run, Inserted on_inserted)
+    {
+        const auto &runs = remap.runs();
+        const auto &inserted = remap.inserted();
+        size_t run = 0, ins = 0;
+        while (run < runs.size() || ins < inserted.size()) {
+            if (ins == inserted.size() || (run < runs.size() && runs[run].new_first < inserted[ins])) {
+                on_run(runs[run++]);
+            } else {
+                on_inserted(ins, inserted[ins]);
+                ins++;
+            }
+        }
+    }
+
+    // col with its kept elements moved to their new ids and the values of the inserted entries (or T())
+    // at theirs
+    template <typename T>
+    static void splice(column<T> &merged, const column<T> &col, const id_remap &remap, const T *inserted)
+    {
+        merged.resize(remap.new_size());
+        T *out = merged.data();
+        for (const auto &run : remap.runs()) {
+            std::copy(col.data() + run.old_first, col.data() + run.old_last, out + run.new_first);
+        }
+        for (size_t ins = 0; ins < remap.inserted().size(); ins++) {
+            out[remap.inserted()[ins]] = inserted ? inserted[ins] : T();
+        }
+    }
+
+    // entries of merged named like directory dir and in its parent, the last directory among them is
+    // the one its children are linked to (as link_children() does)
+    static node_id entry_of_dir(const node_store &merged, dir_id dir)
+    {
+        const auto name = merged.dirs_.name(dir);
+        const dir_id parent = merged.dirs_.parent(dir);
+        size_t first = 0, count = merged.size();
+        while (count > 0) {
+            const size_t half = count / 2;
+            const node_id id = static_cast<node_id>(first + half);
+            const int order = merged[id].basename().compare(name);
+            if (order < 0 || (order == 0 && merged.parent_dir_[id] < parent)) {
+                first += half + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        node_id found = no_node;
+        for (node_id id = static_cast<node_id>(first);
+             id < merged.size() && merged.parent_dir_[id] == parent && merged[id].basename() == name; id++) {
+            if (merged.filetype_[id] == 'd') {
+                found = id;
+            }
+        }
+        return found;
+    }
+
+    // tree links of merged from the ones of this store, see merge_sorted()
+    void relink(node_store &merged, const id_remap &remap, const std::vector<node_id> &deleted,
+                std::vector<node_id> &relinked) const
+    {
+        path_trie &dirs = merged.dirs_;
+        // directories whose entry was deleted or inserted, with the entry they had before
+        std::vector<std::pair<dir_id, node_id>> moved;
+        auto add_moved = [&](dir_id parent, std::string_view name) {
+            const dir_id dir = dirs.find(parent, name);
+            if (dir != no_dir) {
+                moved.emplace_back(dir, dirs.node(dir));
+            }
+        };
+        for (node_id id : deleted) {
+            if (filetype_[id] == 'd') {
+                add_moved(parent_dir_[id], (*this)[id].basename());
+            }
+        }
+        for (node_id id : remap.inserted()) {
+            if (merged.filetype_[id] == 'd') {
+                add_moved(merged.parent_dir_[id], merged[id].basename());
+            }
+        }
+        std::sort(moved.begin(), moved.end());
+        moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
+
+        for (dir_id dir = 0; dir < dirs.size(); dir++) {
+            if (dirs.node(dir) != no_node) {
+                dirs.set_node(dir, remap(dirs.node(dir)));
+            }
+        }
+        // (new parent, child) of every entry that has no parent in the old tree or another one now
+        std::vector<std::pair<node_id, node_id>> added;
+        std::vector<node_id> roots, lost; // lost: old entries whose children moved away
+        for (const auto &dir : moved) {
+            const node_id before = dir.second == no_node ? no_node : remap(dir.second);
+            const node_id now = entry_of_dir(merged, dir.first);
+            dirs.set_node(dir.first, now);
+            if (before == now) {
+                continue;
+            }
+            auto move = [&](node_id old_child) {
+                const node_id child = remap(old_child);
+                if (child != no_node) {
+                    if (now == no_node) {
+                        roots.push_back(child);
+                    } else {
+                        added.emplace_back(now, child);
+                    }
+                }
+            };
+            if (dir.second == no_node) {
+                for (node_id root : roots_) {
+                    if (parent_dir_[root] == dir.first) {
+                        move(root);
+                    }
+                }
+            } else {
+                lost.push_back(dir.second);
+                for (node_id child : children(dir.second)) {
+                    move(child);
+                }
+            }
+            for (node_id id : {before, now}) {
+                if (id != no_node && !std::binary_search(remap.inserted().begin(), remap.inserted().end(), id)) {
+                    relinked.push_back(id);
+                }
+            }
+        }
+        for (node_id id : remap.inserted()) {
+            const node_id parent = merged.parent_node(id);
+            if (parent == no_node) {
+                roots.push_back(id);
+            } else {
+                added.emplace_back(parent, id);
+            }
+        }
+        std::sort(added.begin(), added.end());
+        std::sort(lost.begin(), lost.end());
+
+        for (node_id root : roots_) {
+            const node_id now = remap(root);
+            if (now != no_node && merged.parent_node(now) == no_node) {
+                roots.push_back(now);
+            }
+        }
+        std::sort(roots.begin(), roots.end());
+        roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+        merged.roots_.clear();
+        merged.roots_.append(roots.begin(), roots.end());
+
+        // children of every entry in new id order: the remaining old ones merged with the added ones
+        merged.child_offset_.resize(merged.size() + 1);
+        merged.children_.resize(children_.size() + added.size());
+        uint32_t *offset = merged.child_offset_.data();
+        node_id *out = merged.children_.data();
+        uint32_t count = 0;
+        auto next = added.begin();
+        auto link = [&](node_id parent, const node_id *old_first, const node_id *old_last) {
+            offset[parent] = count;
+            for (; old_first != old_last; old_first++) {
+                const node_id child = remap(*old_first);
+                if (child == no_node) {
+                    continue;
+                }
+                for (; next != added.end() && next->first == parent && next->second < child; ++next) {
+                    out[count++] = next->second;
+                }
+                out[count++] = child;
+            }
+            for (; next != added.end() && next->first == parent; ++next) {
+                out[count++] = next->second;
+            }
+        };
+        for_each_in_order(
+            remap,
+            [&](const id_remap::run &run) {
+                for (node_id id = run.old_first; id < run.old_last; id++) {
+                    const node_id parent = run.new_first + (id - run.old_first);
+                    if (std::binary_search(lost.begin(), lost.end(), id)) {
+                        link(parent, nullptr, nullptr);
+                    } else {
+                        const auto old_children = children(id);
+                        link(parent, old_children.begin(), old_children.end());
+                    }
+                }
+            },
+            [&](size_t, node_id id) { link(id, nullptr, nullptr); });
+        offset[merged.size()] = count;
+        merged.children_.resize(count);
+    }
+
+    // visits every column together with its snapshot section name
+    template <typename Self, typename F>
+    static void for_each_column(Self &self, F f)
+    {
+        f("kilobyte", self.kilobyte_);
+        f("inode", self.inode_);
+        f("filetype", self.filetype_);
+        f("atime", self.atime_);
+        f("name_offset", self.name_offset_);
+        f("name_length", self.name_length_);
+        f("parent_dir", self.parent_dir_);
+        f("hash", self.hash_);
+        f("cum_kilobyte", self.cum_kilobyte_);
+        f("file_count", self.file_count_);
+        f("child_offset", self.child_offset_);
+        f("children", self.children_);
+        f("roots", self.roots_);
+        f("arena", self.arena_);
+    }
+
+public:
+    class iterator
+    {
+    private:
+        const node_store *store_;
+        node_id id_;
+
+    public:
+        iterator(const node_store &store, node_id id) : store_(&store), id_(id) {}
+        node operator*() const { return node(*store_, id_); }
+        iterator &operator++() { id_++; return *this; }
+        bool operator!=(const iterator &other) const { return id_ != other.id_; }
+        bool operator==(const iterator &other) const { return id_ == other.id_; }
+    };
+
+    size_t size() const { return kilobyte_.size(); }
+    bool empty() const { return kilobyte_.empty(); }
+    node operator[](size_t id) const { return node(*this, static_cast<node_id>(id)); }
+    iterator begin() const { return iterator(*this, 0); }
+    iterator end() const { return iterator(*this, static_cast<node_id>(size())); }
+
+    path_trie &dirs() { return dirs_; }
+    const path_trie &dirs() const { return dirs_; }
+
+    void reserve(size_t entries, size_t arena_bytes)
+    {
+        kilobyte_.reserve(entries);
+        inode_.reserve(entries);
+        filetype_.reserve(entries);
+        atime_.reserve(entries);
+        name_offset_.reserve(entries);
+        name_length_.reserve(entries);
+        parent_dir_.reserve(entries);
+        arena_.reserve(arena_bytes);
+    }
+
+    // adds an entry named name in the already interned directory parent (no_dir if it has none)
+    node_id add(size_t kilobyte, uint64_t inode, int64_t atime, char filetype, dir_id parent, std::string_view name)
+    {
+        if (size() >= std::numeric_limits<node_id>::max() - 1) {
+            throw std::length_error("too many index entries");
+        }
+        kilobyte_.push_back(kilobyte);
+        inode_.push_back(inode);
+        filetype_.push_back(filetype);
+        atime_.push_back(atime);
+        name_offset_.push_back(arena_.size());
+        name_length_.push_back(static_cast<uint16_t>(std::min<size_t>(name.size(), UINT16_MAX)));
+        parent_dir_.push_back(parent);
+        arena_.append(name.begin(), name.begin() + name_length_.back());
+        return static_cast<node_id>(size() - 1);
+    }
+
+    node_id add(size_t kilobyte, uint64_t inode, int64_t atime, char filetype, std::string_view file)
+    {
+        std::string_view dir, name;
+        const dir_id parent = split_path(file, dir, name) ? dirs_.intern_path(dir) : no_dir;
+        return add(kilobyte, inode, atime, filetype, parent, name);
+    }
+
+    // moves the entries of another (not yet linked) store to the end of this one
+    void append(node_store &&other)
+    {
+        const uint64_t base = arena_.size();
+        const auto remap = dirs_.merge(other.dirs_);
+        kilobyte_.append(other.kilobyte_.begin(), other.kilobyte_.end());
+        inode_.append(other.inode_.begin(), other.inode_.end());
+        filetype_.append(other.filetype_.begin(), other.filetype_.end());
+        atime_.append(other.atime_.begin(), other.atime_.end());
+        for (uint64_t offset : other.name_offset_) {
+            name_offset_.push_back(base + offset);
+        }
+        name_length_.append(other.name_length_.begin(), other.name_length_.end());
+        for (dir_id parent : other.parent_dir_) {
+            parent_dir_.push_back(parent == no_dir ? no_dir : remap[parent]);
+        }
+        arena_.append(other.arena_.begin(), other.arena_.end());
+        other = node_store();
+    }
+
+    // entries are ordered by basename, entries with the same basename by parent directory
+    static bool entry_less(const node_store &lhs_store, node_id lhs, const node_store &rhs_store, node_id rhs)
+    {
+        const int order = lhs_store[lhs].basename().compare(rhs_store[rhs].basename());
+        return order != 0 ? order < 0 : lhs_store.parent_dir_[lhs] < rhs_store.parent_dir_[rhs];
+    }
+
+    // orders all entries (see entry_less), the arena is rewritten in the same order so scans stay sequential
+    void sort_by_basename()
+    {
+        std::vector<node_id> order(size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](node_id lhs, node_id rhs) {
+            return entry_less(*this, lhs, *this, rhs);
+        });
+        column<char> arena;
+        arena.reserve(arena_.size());
+        for (node_id id : order) {
+            const char *name = arena_.data() + name_offset_[id];
+            name_offset_[id] = arena.size();
+            arena.append(name, name + name_length_[id]);
+        }
+        arena_.swap(arena);
+        permute(kilobyte_, order);
+        permute(inode_, order);
+        permute(filetype_, order);
+        permute(atime_, order);
+        permute(name_offset_, order);
+        permute(name_length_, order);
+        permute(parent_dir_, order);
+    }
+
+    // Replaces the entries by the ones that are not deleted (ascending ids) plus the entries of inserted,
+    // still in sort order. inserted must be sorted and refer to directories in this store's path_trie.
+    // Kept entries are copied run by run and keep their subtree hashes and sizes. The tree stays linked:
+    // kept entries only get their new ids, except for the children of directories whose entry was deleted
+    // or inserted, which move to the directory's entry now. Kept entries that got or lost such children
+    // are added to relinked, their subtree data (and that of inserted entries) still has to be computed.
+    id_remap merge_sorted(const std::vector<node_id> &deleted, const node_store &inserted,
+                          std::vector<node_id> &relinked)
+    {
+        // an inserted entry goes before the first old entry that sorts after it
+        id_remap remap(size());
+        node_id old_id = 0;
+        size_t next_deleted = 0;
+        for (node_id ins = 0; ins <= inserted.size(); ins++) {
+            node_id until = static_cast<node_id>(size());
+            if (ins < inserted.size()) {
+                size_t first = old_id, count = size() - old_id;
+                while (count > 0) {
+                    const size_t half = count / 2;
+                    if (!entry_less(inserted, ins, *this, static_cast<node_id>(first + half))) {
+                        first += half + 1;
+                        count -= half + 1;
+                    } else {
+                        count = half;
+                    }
+                }
+                until = static_cast<node_id>(first);
+            }
+            while (old_id < until) {
+                const node_id end = next_deleted < deleted.size() && deleted[next_deleted] < until
+                                        ? deleted[next_deleted]
+                                        : until;
+                remap.keep(old_id, end);
+                old_id = end;
+                if (next_deleted < deleted.size() && deleted[next_deleted] == old_id) {
+                    old_id++;
+                    next_deleted++;
+                }
+            }
+            if (ins < inserted.size()) {
+                remap.insert();
+            }
+        }
+
+        const node_store &old = *this; // read through const, so shared columns are not copied first
+        node_store merged;
+        splice(merged.kilobyte_, kilobyte_, remap, inserted.kilobyte_.data());
+        splice(merged.inode_, inode_, remap, inserted.inode_.data());
+        splice(merged.filetype_, filetype_, remap, inserted.filetype_.data());
+        splice(merged.atime_, atime_, remap, inserted.atime_.data());
+        splice(merged.name_length_, name_length_, remap, inserted.name_length_.data());
+        splice(merged.parent_dir_, parent_dir_, remap, inserted.parent_dir_.data());
+        splice<hash128>(merged.hash_, hash_, remap, nullptr);
+        splice<uint64_t>(merged.cum_kilobyte_, cum_kilobyte_, remap, nullptr);
+        splice<uint64_t>(merged.file_count_, file_count_, remap, nullptr);
+        // names stay back to back in entry order, a run of kept names is copied at once
+        merged.name_offset_.resize(remap.new_size());
+        merged.arena_.reserve(arena_.size() + inserted.arena_.size());
+        uint64_t *name_offset = merged.name_offset_.data();
+        for_each_in_order(
+            remap,
+            [&](const id_remap::run &run) {
+                const uint64_t first = old.name_offset_[run.old_first];
+                const uint64_t last = old.name_offset_[run.old_last - 1] + old.name_length_[run.old_last - 1];
+                const uint64_t shift = merged.arena_.size() - first;
+                merged.arena_.append(old.arena_.data() + first, old.arena_.data() + last);
+                for (node_id id = run.old_first; id < run.old_last; id++) {
+                    name_offset[run.new_first + (id - run.old_first)] = old.name_offset_[id] + shift;
+                }
+            },
+            [&](size_t ins, node_id id) {
+                const auto name = inserted[ins].basename();
+                name_offset[id] = merged.arena_.size();
+                merged.arena_.append(name.begin(), name.end());
+            });
+        merged.dirs_ = std::move(dirs_);
+        relink(merged, remap, deleted, relinked);
+        *this = std::move(merged);
+        return remap;
+    }
+
+    // links every directory entry to its interned component and every entry to the entry of its parent
+    // directory, a single pass without allocations per entry
+    void link_children()
+    {
+        dirs_.clear_nodes();
+        for (node_id id = 0; id < size(); id++) {
+            if (filetype_[id] == 'd') {
+                const dir_id self = dirs_.find(parent_dir_[id], (*this)[id].basename());
+                if (self != no_dir) {
+                    dirs_.set_node(self, id);
+                }
+            }
+        }
+        child_offset_.assign(size() + 1, 0);
+        roots_.clear();
+        for (node_id id = 0; id < size(); id++) {
+            const node_id parent = parent_node(id);
+            if (parent != no_node) {
+                child_offset_[parent + 1]++;
+            }
+        }
+        std::partial_sum(child_offset_.begin(), child_offset_.end(), child_offset_.begin());
+        children_.resize(child_offset_.back());
+        std::vector<uint32_t> fill(child_offset_.begin(), child_offset_.end() - 1);
+        for (node_id id = 0; id < size(); id++) {
+            const node_id parent = parent_node(id);
+            if (parent == no_node) {
+                roots_.push_back(id);
+            } else {
+                children_[fill[parent]++] = id;
+            }
+        }
+        // subtree data is filled in by hash_tree(), entries kept by merge_sorted() keep theirs
+        if (hash_.size() != size()) {
+            hash_.assign(size(), hash128());
+            cum_kilobyte_.assign(size(), 0);
+            file_count_.assign(size(), 0);
+        }
+    }
+
+    node_id parent_node(node_id id) const
+    {
+        return parent_dir_[id] == no_dir ? no_node : dirs_.node(parent_dir_[id]);
+    }
+
+    id_range children(node_id id) const
+    {
+        return {children_.data() + child_offset_[id], children_.data() + child_offset_[id + 1]};
+    }
+    id_range roots() const { return {roots_.data(), roots_.data() + roots_.size()}; }
+
+    dir_id parent_dir(node_id id) const { return parent_dir_[id]; }
+
+    void set_kilobyte(node_id id, size_t kb) { kilobyte_[id] = kb; }
+    void set_atime(node_id id, int64_t atime) { atime_[id] = atime; }
+    void set_hash(node_id id, const hash128 &hash) { hash_[id] = hash; }
+    void set_cum_kilobyte(node_id id, size_t kb) { cum_kilobyte_[id] = kb; }
+    void set_file_count(node_id id, size_t count) { file_count_[id] = count; }
+    // before the setters above are called from several threads, see column::detach()
+    void detach_subtree_data()
+    {
+        hash_.detach();
+        cum_kilobyte_.detach();
+        file_count_.detach();
+    }
+
+    size_t arena_bytes() const { return arena_.size(); }
+
+    // all basenames back to back, in entry order once sort_by_basename() ran
+    std::string_view names() const { return {arena_.data(), arena_.size()}; }
+    uint64_t name_offset(node_id id) const { return name_offset_[id]; }
+
+    // heap bytes, columns mapped from a snapshot only count once their pages are faulted in (see RSS)
+    size_t memory_usage() const
+    {
+        size_t total = dirs_.memory_usage();
+        for_each_column(*this, [&total](const char *, const auto &col) {
+            total += col.heap_bytes();
+        });
+        return total;
+    }
+
+    void save(snapshot_writer &writer) const
+    {
+        for_each_column(*this, [&writer](const char *name, const auto &col) {
+            writer.add(std::string("nodes.") + name, col);
+        });
+        dirs_.save(writer);
+    }
+
+    void load(const snapshot_reader &reader)
+    {
+        for_each_column(*this, [&reader](const char *name, auto &col) {
+            reader.load(std::string("nodes.") + name, col);
+        });
+        if (inode_.size() != size() || name_offset_.size() != size() || parent_dir_.size() != size() ||
+            hash_.size() != size() || file_count_.size() != size() || child_offset_.size() != size() + 1) {
+            throw std::runtime_error("snapshot node columns are inconsistent");
+        }
+        dirs_.load(reader);
+    }
+};
+
+inline size_t node::kilobyte() const { return store_->kilobyte_[id_]; }
+inline uint64_t node::inode() const { return store_->inode_[id_]; }
+inline char node::filetype() const { return store_->filetype_[id_]; }
+inline int64_t node::atime() const { return store_->atime_[id_]; }
+inline std::string_view node::basename() const
+{
+    return {store_->arena_.data() + store_->name_offset_[id_], store_->name_length_[id_]};
+}
+inline std::string node::parent_file() const
+{
+    const dir_id parent = store_->parent_dir_[id_];
+    return parent == no_dir ? std::string() : store_->dirs_.path(parent);
+}
+inline std::string node::file() const
+{
+    std::string result;
+    const dir_id parent = store_->parent_dir_[id_];
+    if (parent != no_dir) {
+        store_->dirs_.append_path(parent, result);
+        result += '/';
+    }
+    result.append(basename());
+    return result;
+}
+inline dir_id node::parent_dir() const { return store_->parent_dir_[id_]; }
+inline hash128 node::my_hash() const { return store_->hash_[id_]; }
+inline size_t node::cum_kilobyte() const { return store_->cum_kilobyte_[id_]; }
+inline size_t node::file_count() const { return store_->file_count_[id_]; }
@@ -0,0 +1,166 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "column.h"
+#include "snapshot.h"
+
+using node_id = uint32_t;
+using dir_id = uint32_t;
+constexpr node_id no_node = std::numeric_limits<node_id>::max();
+constexpr dir_id no_dir = std::numeric_limits<dir_id>::max();
+
+// Interned directory components: every directory is stored once as (parent, name), so "/mnt/foo" is
+// component "foo" under component "mnt" under the top-level component "" (the part before the first slash).
+class path_trie
+{
+private:
+    column<dir_id> parent_;
+    column<uint64_t> name_offset_;
+    column<uint16_t> name_length_;
+    column<node_id> node_; // the index entry of the directory itself, if it was indexed
+    column<char> arena_;
+    // open addressing table over component ids, only needed while interning
+    column<dir_id> table_;
+
+    uint64_t hash(dir_id parent, std::string_view name) const
+    {
+        return fnv1a(name, 14695981039346656037ULL ^ (uint64_t(parent) * 0x9e3779b97f4a7c15ULL));
+    }
+
+    size_t slot(dir_id parent, std::string_view name) const
+    {
+        const size_t mask = table_.size() - 1;
+        size_t pos = hash(parent, name) & mask;
+        while (table_[pos] != no_dir && (parent_[table_[pos]] != parent || this->name(table_[pos]) != name)) {
+            pos = (pos + 1) & mask;
+        }
+        return pos;
+    }
+
+    void rehash(size_t buckets)
+    {
+        table_.assign(buckets, no_dir);
+        for (dir_id id = 0; id < size(); id++) {
+            table_[slot(parent_[id], name(id))] = id;
+        }
+    }
+
+public:
+    size_t size() const { return parent_.size(); }
+    dir_id parent(dir_id id) const { return parent_[id]; }
+    std::string_view name(dir_id id) const { return {arena_.data() + name_offset_[id], name_length_[id]}; }
+    node_id node(dir_id id) const { return node_[id]; }
+    void set_node(dir_id id, node_id n) { node_[id] = n; }
+    void clear_nodes() { node_.assign(size(), no_node); }
+
+    dir_id find(dir_id parent, std::string_view name) const
+    {
+        return table_.empty() ? no_dir : table_[slot(parent, name)];
+    }
+
+    dir_id intern(dir_id parent, std::string_view name)
+    {
+        if ((size() + 1) * 2 > table_.size()) {
+            rehash(table_.empty() ? 1024 : table_.size() * 2);
+        }
+        const size_t pos = slot(parent, name);
+        // read through const, a directory that is already there leaves a shared table shared
+        const dir_id found = std::as_const(table_)[pos];
+        if (found != no_dir) {
+            return found;
+        }
+        if (size() >= no_dir - 1) {
+            throw std::length_error("too many directories");
+        }
+        const dir_id id = static_cast<dir_id>(size());
+        parent_.push_back(parent);
+        name_offset_.push_back(arena_.size());
+        name_length_.push_back(static_cast<uint16_t>(std::min<size_t>(name.size(), UINT16_MAX)));
+        node_.push_back(no_node);
+        arena_.append(name.begin(), name.begin() + name_length_.back());
+        table_[pos] = id;
+        return id;
+    }
+
+    // interns "/a/b/c" as c under b under a under ""
+    dir_id intern_path(std::string_view path)
+    {
+        const size_t slash = path.find_last_of('/');
+        if (slash == std::string_view::npos) {
+            return intern(no_dir, path);
+        }
+        return intern(intern_path(path.substr(0, slash)), path.substr(slash + 1));
+    }
+
+    void append_path(dir_id id, std::string &out) const
+    {
+        if (parent_[id] != no_dir) {
+            append_path(parent_[id], out);
+            out += '/';
+        }
+        out.append(name(id));
+    }
+
+    std::string path(dir_id id) const
+    {
+        std::string result;
+        append_path(id, result);
+        return result;
+    }
+
+    // interns all components of other, returns the new id of each of its components
+    std::vector<dir_id> merge(const path_trie &other)
+    {
+        std::vector<dir_id> remap(other.size());
+        // parents are always interned before their children, so they are remapped first
+        for (dir_id id = 0; id < other.size(); id++) {
+            const dir_id parent = other.parent(id);
+            remap[id] = intern(parent == no_dir ? no_dir : remap[parent], other.name(id));
+        }
+        return remap;
+    }
+
+    size_t memory_usage() const
+    {
+        return parent_.heap_bytes() + name_offset_.heap_bytes() + name_length_.heap_bytes() + node_.heap_bytes() +
+               arena_.heap_bytes() + table_.heap_bytes();
+    }
+
+    void save(snapshot_writer &writer) const
+    {
+        writer.add("dirs.parent", parent_);
+        writer.add("dirs.name_offset", name_offset_);
+        writer.add("dirs.name_length", name_length_);
+        writer.add("dirs.node", node_);
+        writer.add("dirs.arena", arena_);
+    }
+
+    void load(const snapshot_reader &reader)
+    {
+        reader.load("dirs.parent", parent_);
+        reader.load("dirs.name_offset", name_offset_);
+        reader.load("dirs.name_length", name_length_);
+        reader.load("dirs.node", node_);
+        reader.load("dirs.arena", arena_);
+        if (name_offset_.size() != size() || name_length_.size() != size() || node_.size() != size()) {
+            throw std::runtime_error("snapshot directory columns are inconsistent");
+        }
+        size_t buckets = 1024;
+        while (buckets < size() * 2 + 2) {
+            buckets *= 2;
+        }
+        rehash(buckets);
+    }
+};
@@ -0,0 +1,85 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+// Tells a running query whether it should give up: because the same session sent a newer query (whose
+// results replace this one's in the browser anyway) or because its deadline passed. Checking is a load
+// and a clock read, scans check every few thousand entries.
+class query_context
+{
+private:
+    std::shared_ptr<const std::atomic<uint64_t>> latest_; // newest generation of the session, if any
+    uint64_t generation_ = 0;
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();
+
+public:
+    query_context() = default;
+
+    query_context(std::shared_ptr<const std::atomic<uint64_t>> latest, uint64_t generation,
+                  std::chrono::steady_clock::time_point deadline)
+        : latest_(std::move(latest)), generation_(generation), deadline_(deadline)
+    {}
+
+    bool superseded() const { return latest_ && latest_->load(std::memory_order_relaxed) > generation_; }
+
+    bool expired() const { return std::chrono::steady_clock::now() >= deadline_; }
+
+    bool cancelled() const { return superseded() || expired(); }
+};
+
+// The newest query generation of each client session. index.html numbers its queries, a query with a
+// lower number than one the session already sent is superseded.
+class query_sessions
+{
+private:
+    static constexpr size_t max_sessions = 4096;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<std::atomic<uint64_t>>> sessions_;
+    std::chrono::milliseconds timeout_;
+
+public:
+    explicit query_sessions(std::chrono::milliseconds timeout) : timeout_(timeout) {}
+
+    // session and generation are the ?session= and ?generation= parameters of the request, without them
+    // a query can only run into its deadline
+    query_context begin(const char *session, const char *generation)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout_;
+        if (!session || !generation) {
+            return query_context({}, 0, deadline);
+        }
+        const uint64_t number = std::strtoull(generation, nullptr, 10);
+        std::shared_ptr<std::atomic<uint64_t>> latest;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (sessions_.size() >= max_sessions) {
+                // forget sessions without running queries, they start over with their next query
+                for (auto iter = sessions_.begin(); iter != sessions_.end();) {
+                    iter = iter->second.use_count() == 1 ? sessions_.erase(iter) : std::next(iter);
+                }
+            }
+            auto &slot = sessions_[session];
+            if (!slot) {
+                slot = std::make_shared<std::atomic<uint64_t>>(0);
+            }
+            latest = slot;
+        }
+        uint64_t current = latest->load();
+        while (current < number && !latest->compare_exchange_weak(current, number)) {
+        }
+        return query_context(std::move(latest), number, deadline);
+    }
+};
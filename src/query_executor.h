@@ -0,0 +1,225 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <optional>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+
+// cheap point lookups are started before scans
+enum class query_class { lookup = 0, scan = 1 };
+
+struct route_stats
+{
+    std::string route;
+    query_class priority;
+    size_t running;
+    size_t queued;
+    size_t completed;
+    size_t rejected;
+    double wait_p50_ms; // upper bounds, waits are counted in power of two buckets
+    double wait_p99_ms;
+    double wait_max_ms;
+};
+
+// Runs the work of requests on its own threads instead of the web server's. Every route has a priority
+// class, a limit on how many of its queries run at the same time and on how many may wait; a query that
+// would exceed the latter is rejected right away so the caller can answer 503. Waiting queries of the
+// lookup class are started first, a scan can only take the threads its route is allowed to use.
+class query_executor
+{
+private:
+    static constexpr size_t num_buckets = 40; // bucket i counts waits below 2^i microseconds
+
+    struct route_state
+    {
+        std::string name;
+        query_class priority;
+        size_t max_running;
+        size_t max_queued;
+        size_t running = 0;
+        size_t queued = 0;
+        size_t completed = 0;
+        size_t rejected = 0;
+        uint64_t wait_max_us = 0;
+        uint64_t wait_buckets[num_buckets] = {};
+    };
+
+    struct job
+    {
+        route_state *route;
+        std::function<void()> work;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    std::vector<std::unique_ptr<route_state>> routes_;
+    std::deque<job> queues_[2]; // by query_class
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool stopping_ = false;
+
+    route_state &route(const std::string &name)
+    {
+        for (auto &route : routes_) {
+            if (route->name == name) {
+                return *route;
+            }
+        }
+        throw std::runtime_error("no limits for route " + name);
+    }
+
+    // the first queued job, by priority, whose route may start another query; called with mutex_ held
+    bool next_job(job &out)
+    {
+        for (auto &queue : queues_) {
+            for (auto iter = queue.begin(); iter != queue.end(); ++iter) {
+                if (iter->route->running < iter->route->max_running) {
+                    out = std::move(*iter);
+                    queue.erase(iter);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            job next;
+            ready_.wait(lock, [&] { return stopping_ || next_job(next); });
+            if (!next.work) {
+                return;
+            }
+            auto &route = *next.route;
+            const auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - next.enqueued).count();
+            route.queued--;
+            route.running++;
+            route.wait_max_us = std::max<uint64_t>(route.wait_max_us, waited);
+            size_t bucket = 0;
+            while (bucket + 1 < num_buckets && (uint64_t(1) << bucket) <= uint64_t(waited)) {
+                bucket++;
+            }
+            route.wait_buckets[bucket]++;
+            lock.unlock();
+            next.work();
+            lock.lock();
+            route.running--;
+            route.completed++;
+            ready_.notify_all(); // a job of this route may be able to run now
+        }
+    }
+
+    static double wait_percentile_ms(const route_state &route, double fraction)
+    {
+        size_t total = 0;
+        for (uint64_t count : route.wait_buckets) {
+            total += count;
+        }
+        size_t seen = 0;
+        for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+            seen += route.wait_buckets[bucket];
+            if (total > 0 && seen >= fraction * total) {
+                return (uint64_t(1) << bucket) / 1000.0;
+            }
+        }
+        return 0;
+    }
+
+public:
+    explicit query_executor(size_t num_threads)
+    {
+        for (size_t i = 0; i < num_threads; i++) {
+            threads_.emplace_back([this] { work(); });
+        }
+    }
+
+    ~query_executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    query_executor(const query_executor &) = delete;
+    query_executor &operator=(const query_executor &) = delete;
+
+    size_t size() const { return threads_.size(); }
+
+    // has to be called for every route before its first query
+    void add_route(const std::string &name, query_class priority, size_t max_running, size_t max_queued)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        routes_.emplace_back(new route_state{name, priority, max_running, max_queued});
+    }
+
+    // the most queries of a class that can be running or waiting at the same time
+    size_t capacity(query_class priority)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t total = 0;
+        for (const auto &route : routes_) {
+            total += route->priority == priority ? route->max_running + route->max_queued : 0;
+        }
+        return total;
+    }
+
+    // Runs work on an executor thread and waits for its result, exceptions are passed on. Returns nothing
+    // without running work if too many queries of the route are waiting already.
+    template <typename F>
+    std::optional<std::invoke_result_t<F>> run(const std::string &name, F work)
+    {
+        using result = std::invoke_result_t<F>;
+        std::packaged_task<result()> task(std::move(work));
+        auto future = task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &state = route(name);
+            if (state.queued >= state.max_queued) {
+                state.rejected++;
+                return std::nullopt;
+            }
+            state.queued++;
+            // std::function needs a copyable callable
+            auto shared = std::make_shared<std::packaged_task<result()>>(std::move(task));
+            queues_[static_cast<size_t>(state.priority)].push_back(
+                {&state, [shared] { (*shared)(); }, std::chrono::steady_clock::now()});
+        }
+        ready_.notify_one(); // any idle thread can take it, if the route allows another query at all
+        return future.get();
+    }
+
+    std::vector<route_stats> stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<route_stats> stats;
+        for (const auto &route : routes_) {
+            stats.push_back({route->name, route->priority, route->running, route->queued, route->completed,
+                             route->rejected, wait_percentile_ms(*route, 0.5), wait_percentile_ms(*route, 0.99),
+                             route->wait_max_us / 1000.0});
+        }
+        return stats;
+    }
+};
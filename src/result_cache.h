@@ -0,0 +1,165 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+#include "node_store.h"
+
+struct index_version;
+
+// All entries matching a query, in entry order, without limit, cursor or exclusions applied: those are
+// cheap to apply while the rows are written, so one entry serves every page and variation of a query.
+struct cached_matches
+{
+    std::vector<node_id> ids;
+    bool complete = true; // false: too many matches to keep, the query is answered without the cache
+};
+
+struct result_cache_stats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t refinements = 0; // misses answered by filtering the matches of a shorter term
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Bounded LRU cache of query results shared by all request threads. Keys are spread over shards with a
+// lock each, so concurrent requests rarely wait for each other. Entries belong to the index version they
+// were computed on and are never returned for another one.
+class result_cache
+{
+private:
+    static constexpr size_t num_shards = 16;
+
+    struct entry
+    {
+        std::string key;
+        std::weak_ptr<const index_version> version;
+        std::shared_ptr<const cached_matches> matches;
+        size_t bytes;
+    };
+
+    struct shard
+    {
+        std::mutex mutex;
+        std::list<entry> lru; // most recently used first
+        std::unordered_map<std::string, std::list<entry>::iterator> entries;
+        size_t bytes = 0;
+    };
+
+    shard shards_[num_shards];
+    size_t shard_capacity_;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+    std::atomic<size_t> refinements_{0};
+
+    shard &shard_of(const std::string &key) { return shards_[std::hash<std::string>()(key) % num_shards]; }
+
+    static bool same_version(const std::weak_ptr<const index_version> &lhs,
+                             const std::shared_ptr<const index_version> &rhs)
+    {
+        return !lhs.owner_before(rhs) && !rhs.owner_before(lhs);
+    }
+
+    static void erase(shard &s, std::list<entry>::iterator iter)
+    {
+        s.bytes -= iter->bytes;
+        s.entries.erase(iter->key);
+        s.lru.erase(iter);
+    }
+
+public:
+    explicit result_cache(size_t capacity_bytes = 64 * 1024 * 1024) : shard_capacity_(capacity_bytes / num_shards) {}
+
+    // the largest number of matches an entry can hold
+    size_t max_matches() const { return shard_capacity_ / sizeof(node_id) / 2; }
+
+    static std::string key(const std::string &route, const std::string &term) { return route + '\n' + term; }
+
+    // nullptr if key was not computed on version (yet); counts as a hit or a miss
+    std::shared_ptr<const cached_matches> get(const std::string &key,
+                                              const std::shared_ptr<const index_version> &version)
+    {
+        auto result = peek(key, version);
+        (result ? hits_ : misses_)++;
+        return result;
+    }
+
+    // get() without counting, for looking up shorter terms to refine
+    std::shared_ptr<const cached_matches> peek(const std::string &key,
+                                               const std::shared_ptr<const index_version> &version)
+    {
+        auto &s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        const auto iter = s.entries.find(key);
+        if (iter == s.entries.end()) {
+            return nullptr;
+        }
+        if (!same_version(iter->second->version, version)) {
+            erase(s, iter->second);
+            return nullptr;
+        }
+        s.lru.splice(s.lru.begin(), s.lru, iter->second);
+        return iter->second->matches;
+    }
+
+    void put(const std::string &key, const std::shared_ptr<const index_version> &version,
+             std::shared_ptr<const cached_matches> matches)
+    {
+        const size_t bytes = sizeof(entry) + 2 * key.size() + matches->ids.capacity() * sizeof(node_id);
+        if (bytes > shard_capacity_) {
+            return;
+        }
+        auto &s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        const auto iter = s.entries.find(key);
+        if (iter != s.entries.end()) {
+            erase(s, iter->second);
+        }
+        while (s.bytes + bytes > shard_capacity_) {
+            erase(s, std::prev(s.lru.end()));
+        }
+        s.lru.push_front({key, version, std::move(matches), bytes});
+        s.entries[key] = s.lru.begin();
+        s.bytes += bytes;
+    }
+
+    void count_refinement() { refinements_++; }
+
+    // drops all entries, e.g. when a new version was published and the old entries can only go stale
+    void clear()
+    {
+        for (auto &s : shards_) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.lru.clear();
+            s.entries.clear();
+            s.bytes = 0;
+        }
+    }
+
+    result_cache_stats stats()
+    {
+        result_cache_stats stats;
+        stats.hits = hits_;
+        stats.misses = misses_;
+        stats.refinements = refinements_;
+        for (auto &s : shards_) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            stats.entries += s.lru.size();
+            stats.bytes += s.bytes;
+        }
+        return stats;
+    }
+};
@@ -0,0 +1,278 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <cstdio>
+
+#include "node_store.h"
+
+enum class result_format { html, json };
+
+// ?format=json selects JSON, anything else the HTML index.html shows
+inline result_format result_format_of(const char *param)
+{
+    return param && std::string_view(param) == "json" ? result_format::json : result_format::html;
+}
+
+inline void append_json_string(std::string &out, std::string_view s)
+{
+    out += '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(c)));
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+inline void append_html_escaped(std::string &out, std::string_view s)
+{
+    for (char c : s) {
+        switch (c) {
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '&': out += "&amp;"; break;
+        case '"': out += "&quot;"; break;
+        default: out += c;
+        }
+    }
+}
+
+// percent-encodes everything but unreserved characters, for cursors in next page urls
+inline void append_url_encoded(std::string &out, std::string_view s)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    for (char c : s) {
+        const unsigned char u = static_cast<unsigned char>(c);
+        if ((u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '-' || u == '_' ||
+            u == '.' || u == '~') {
+            out += c;
+        } else {
+            out += '%';
+            out += hex[u >> 4];
+            out += hex[u & 15];
+        }
+    }
+}
+
+// Position in a listing of entries, the next page starts after it. Entries are identified by their
+// basename, shard and interned parent directory, which is the sort order of the node_store (see entry_less)
+// with the entries of equal basenames in several shards in shard order, and stays valid while the index is
+// updated in place. Listings by size or access time put those in front.
+struct entry_cursor
+{
+    bool valid = false;
+    uint64_t kilobyte = 0; // only for listings by size
+    int64_t atime = 0;     // only for listings by access time
+    uint32_t shard = 0;
+    dir_id parent = no_dir;
+    std::string basename;
+    int shard_order = 0; // how the shard searched with this cursor compares to shard, see in_shard()
+
+    static entry_cursor at(const node &n, uint32_t shard = 0)
+    {
+        entry_cursor cursor;
+        cursor.valid = true;
+        cursor.kilobyte = n.kilobyte();
+        cursor.atime = n.atime();
+        cursor.shard = shard;
+        cursor.parent = n.parent_dir();
+        cursor.basename = std::string(n.basename());
+        return cursor;
+    }
+
+    // "kilobyte:atime:shard:parent:basename", an invalid cursor (start at the beginning) if it does not parse
+    static entry_cursor parse(const char *param)
+    {
+        entry_cursor cursor;
+        if (!param) {
+            return cursor;
+        }
+        const std::string_view s(param);
+        size_t colons[4];
+        for (size_t i = 0, from = 0; i < 4; from = colons[i++] + 1) {
+            if ((colons[i] = s.find(':', from)) == std::string_view::npos) {
+                return cursor;
+            }
+        }
+        if (std::from_chars(s.data(), s.data() + colons[0], cursor.kilobyte).ptr != s.data() + colons[0] ||
+            std::from_chars(s.data() + colons[0] + 1, s.data() + colons[1], cursor.atime).ptr != s.data() + colons[1] ||
+            std::from_chars(s.data() + colons[1] + 1, s.data() + colons[2], cursor.shard).ptr != s.data() + colons[2] ||
+            std::from_chars(s.data() + colons[2] + 1, s.data() + colons[3], cursor.parent).ptr != s.data() + colons[3]) {
+            return cursor;
+        }
+        cursor.basename = std::string(s.substr(colons[3] + 1));
+        cursor.valid = true;
+        return cursor;
+    }
+
+    std::string str() const
+    {
+        return std::to_string(kilobyte) + ':' + std::to_string(atime) + ':' + std::to_string(shard) + ':' +
+               std::to_string(parent) + ':' + basename;
+    }
+
+    // the cursor to compare the entries of shard s with: entries of earlier shards with the cursor's
+    // basename come before it, those of later shards after it, whatever their directory
+    entry_cursor in_shard(uint32_t s) const
+    {
+        entry_cursor cursor = *this;
+        cursor.shard_order = s < shard ? -1 : s > shard ? 1 : 0;
+        return cursor;
+    }
+
+    // true if n comes after the cursor in entry order
+    bool before(const node &n) const
+    {
+        if (!valid) {
+            return true;
+        }
+        const int order = n.basename().compare(basename);
+        if (order != 0 || shard_order != 0) {
+            return order != 0 ? order > 0 : shard_order > 0;
+        }
+        return n.parent_dir() > parent;
+    }
+
+    // first entry of [first, last> after the cursor, the range has to be in entry order
+    node_id seek(const node_store &nodes, node_id first, node_id last) const
+    {
+        node_id count = last - first;
+        while (count > 0) {
+            const node_id half = count / 2;
+            if (!before(nodes[first + half])) {
+                first += half + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        return first;
+    }
+
+    // true if n comes after the cursor in size order (see larger_first)
+    bool before_by_size(const node &n) const
+    {
+        if (!valid || n.kilobyte() != kilobyte) {
+            return !valid || n.kilobyte() < kilobyte;
+        }
+        return before(n);
+    }
+
+    // true if n comes after the cursor in access time order (see newer_first)
+    bool before_by_atime(const node &n) const
+    {
+        if (!valid || n.atime() != atime) {
+            return !valid || n.atime() < atime;
+        }
+        return before(n);
+    }
+};
+
+// Rows of the routes listing entries, as the HTML table index.html shows or as JSON. Rows are
+// appended to the response body directly, so a page is built once and sent as is.
+class result_writer
+{
+private:
+    std::string &out_;
+    result_format format_;
+    size_t rows_ = 0;
+
+public:
+    result_writer(std::string &out, result_format format) : out_(out), format_(format)
+    {
+        out_ += format_ == result_format::json
+                    ? "{\"results\":["
+                    : "<table class=\"sortable\"><thead><tr><th>Type</th><th>File</th><th>Date</th></tr></thead><tbody>";
+    }
+
+    void write(const node &n) { write(n.filetype(), n.file(), n.kilobyte(), n.date()); }
+
+    // a row that is not in this index, e.g. one a peer sent (see coordinator.h)
+    void write(char filetype, std::string_view file, uint64_t kilobyte, std::string_view date)
+    {
+        if (format_ == result_format::json) {
+            out_ += rows_ ? ",\n{\"type\":\"" : "\n{\"type\":\"";
+            out_ += filetype;
+            out_ += "\",\"file\":";
+            append_json_string(out_, file);
+            out_ += ",\"kilobyte\":";
+            out_ += std::to_string(kilobyte);
+            out_ += ",\"date\":\"";
+            out_ += date;
+            out_ += "\"}";
+        } else {
+            out_ += "<tr><td>";
+            out_ += filetype;
+            out_ += "</td><td>";
+            append_html_escaped(out_, file);
+            out_ += "</td><td>";
+            out_ += date;
+            out_ += "</td></tr>\n";
+        }
+        rows_++;
+    }
+
+    size_t rows() const { return rows_; }
+
+    // next_url is where the following page is, empty on the last page; unanswered lists the peers whose
+    // rows are missing, see coordinator.h
+    void finish(const std::string &next_url, const std::vector<std::string> &unanswered = {})
+    {
+        if (format_ == result_format::json) {
+            out_ += "],\n\"next\":";
+            if (next_url.empty()) {
+                out_ += "null";
+            } else {
+                append_json_string(out_, next_url);
+            }
+            if (!unanswered.empty()) {
+                out_ += ",\"unanswered\":[";
+                for (size_t i = 0; i < unanswered.size(); i++) {
+                    out_ += i ? "," : "";
+                    append_json_string(out_, unanswered[i]);
+                }
+                out_ += "]";
+            }
+            out_ += "}\n";
+        } else {
+            out_ += "</tbody></tr></table>";
+            if (!next_url.empty()) {
+                out_ += "<a class=\"next_page\" href=\"";
+                append_html_escaped(out_, next_url);
+                out_ += "\">next page</a>";
+            }
+            for (const auto &peer : unanswered) {
+                out_ += "<p class=\"unanswered\">no answer from ";
+                append_html_escaped(out_, peer);
+                out_ += "</p>";
+            }
+        }
+    }
+};
+
+// url of the next page of route, continuing after cursor
+inline std::string next_page_url(std::string_view route, const entry_cursor &cursor, result_format format)
+{
+    std::string url(route);
+    url += "?cursor=";
+    append_url_encoded(url, cursor.str());
+    if (format == result_format::json) {
+        url += "&format=json";
+    }
+    return url;
+}
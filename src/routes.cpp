@@ -0,0 +1,830 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/algorithm/string/classification.hpp> // Include boost::for is_any_of
+#include <boost/algorithm/string/split.hpp> // Include for boost::split
+
+#include "routes.h"
+#include "result_writer.h"
+#include "scan.h"
+#include "group_by.h"
+#include "metrics.h"
+
+using namespace std;
+
+void compress_response(const crow::request &req, crow::response &res)
+{
+    const size_t threshold = 4096;
+    if (res.body.size() < threshold || !res.get_header_value("Content-Encoding").empty() ||
+        !accepts_gzip(req.get_header_value("Accept-Encoding"))) {
+        return;
+    }
+    res.body = gzip(res.body);
+    res.set_header("Content-Encoding", "gzip");
+    res.set_header("Vary", "Accept-Encoding");
+}
+
+crow::response asset_response(const crow::request &req, const static_asset &asset)
+{
+    crow::response res;
+    res.set_header("ETag", asset.etag);
+    res.set_header("Cache-Control", "no-cache"); // revalidated every time, which costs no body
+    res.set_header("Vary", "Accept-Encoding");
+    if (asset.matches(req.get_header_value("If-None-Match"))) {
+        res.code = 304;
+        return res;
+    }
+    res.set_header("Content-Type", asset.content_type);
+    if (accepts_gzip(req.get_header_value("Accept-Encoding"))) {
+        res.set_header("Content-Encoding", "gzip");
+        res.body = asset.gzipped;
+    } else {
+        res.body = asset.body;
+    }
+    return res;
+}
+
+// what every query route records in default_metrics()
+struct route_metrics
+{
+    counter &requests;
+    counter &errors;     // answered with a 4xx or 5xx, including queries turned away as too many
+    histogram &latency;  // microseconds from arrival to the response, waiting for the executor included
+    histogram &results;  // rows or groups in the response
+
+    explicit route_metrics(const char *route)
+        : requests(default_metrics().add_counter("indexer_requests_total", "Requests answered",
+                                                 metric_label("route", route))),
+          errors(default_metrics().add_counter("indexer_request_errors_total", "Requests answered with an error",
+                                               metric_label("route", route))),
+          latency(default_metrics().add_histogram("indexer_request_duration_seconds",
+                                                  "Seconds from the arrival of a request to its response", 1e-6, 26,
+                                                  metric_label("route", route))),
+          results(default_metrics().add_histogram("indexer_request_results", "Rows or groups in a response", 1, 24,
+                                                  metric_label("route", route)))
+    {}
+};
+
+// hits and misses of the lookups in the basename table and the trigram index, by route
+static counter &index_lookups(const char *route, const char *result)
+{
+    return default_metrics().add_counter("indexer_index_lookups_total",
+                                         "Lookups of a term in the index, by whether it was found",
+                                         metric_label("route", route) + ',' + metric_label("result", result));
+}
+
+// values kept elsewhere, read on every scrape of /metrics; shards and executor have to outlive the app
+static void add_metric_callbacks(shard_set &shards, query_executor &executor)
+{
+    auto &metrics = default_metrics();
+    for (size_t s = 0; s < shards.size(); s++) {
+        indexer &indexer_ = shards[s];
+        const auto shard = metric_label("shard", indexer_.name_);
+        metrics.add_callback("indexer_index_entries", "Entries in the published index version", "gauge", shard,
+                             [&] { return double(indexer_.current()->nodes.size()); });
+        const auto memory = [&](const char *structure, std::function<size_t(const index_version &)> bytes) {
+            metrics.add_callback("indexer_memory_bytes", "Heap memory of the index structures", "gauge",
+                                 metric_label("structure", structure) + ',' + shard,
+                                 [&indexer_, bytes] { return double(bytes(*indexer_.current())); });
+        };
+        memory("nodes", [](const index_version &index) {
+            return index.nodes.memory_usage() - index.nodes.dirs().memory_usage();
+        });
+        memory("directories", [](const index_version &index) { return index.nodes.dirs().memory_usage(); });
+        memory("basenames", [](const index_version &index) { return index.basenames.memory_usage(); });
+        memory("extensions", [](const index_version &index) { return index.extensions.memory_usage(); });
+        memory("trigrams", [](const index_version &index) { return index.trigrams.memory_usage(); });
+        memory("nodes_by_size", [](const index_version &index) { return index.nodes_by_size.heap_bytes(); });
+        memory("nodes_by_atime", [](const index_version &index) { return index.nodes_by_atime.heap_bytes(); });
+        memory("times", [](const index_version &index) { return index.times.memory_usage(); });
+        memory("dupes", [](const index_version &index) { return index.dupes.memory_usage(); });
+
+        metrics.add_callback("indexer_result_cache_hits_total", "Queries answered from the result cache", "counter",
+                             shard, [&] { return double(indexer_.cache_stats().hits); });
+        metrics.add_callback("indexer_result_cache_misses_total", "Queries not in the result cache", "counter", shard,
+                             [&] { return double(indexer_.cache_stats().misses); });
+        metrics.add_callback("indexer_result_cache_refinements_total",
+                             "Result cache misses answered from the matches of a shorter term", "counter", shard,
+                             [&] { return double(indexer_.cache_stats().refinements); });
+        metrics.add_callback("indexer_result_cache_bytes", "Memory held by the result cache", "gauge", shard,
+                             [&] { return double(indexer_.cache_stats().bytes); });
+    }
+    metrics.add_callback("indexer_resident_memory_bytes", "Resident memory of the process", "gauge", "",
+                         [] { return double(resident_memory_kilobyte()) * 1024; });
+
+    for (const auto &route : executor.stats()) {
+        const auto stat = [&executor, name = route.route](size_t route_stats::*field) {
+            return [&executor, name, field] {
+                for (const auto &route : executor.stats()) {
+                    if (route.route == name) {
+                        return double(route.*field);
+                    }
+                }
+                return 0.0;
+            };
+        };
+        const auto label = metric_label("route", route.route);
+        metrics.add_callback("indexer_queries_running", "Queries running on the executor", "gauge", label,
+                             stat(&route_stats::running));
+        metrics.add_callback("indexer_queries_queued", "Queries waiting for an executor thread", "gauge", label,
+                             stat(&route_stats::queued));
+        metrics.add_callback("indexer_queries_rejected_total", "Queries turned away because too many were waiting",
+                             "counter", label, stat(&route_stats::rejected));
+    }
+}
+
+// ?accessed_after= and ?accessed_before=, see time_range::parse()
+static time_range accessed_range(const crow::request &req)
+{
+    return time_range::parse(req.url_params.get("accessed_after"), req.url_params.get("accessed_before"), local_now());
+}
+
+// next page urls keep the time range of the request
+static string with_accessed_range(string url, const crow::request &req)
+{
+    for (const char *param : {"accessed_after", "accessed_before"}) {
+        if (const char *value = req.url_params.get(param)) {
+            url += '&';
+            url += param;
+            url += '=';
+            append_url_encoded(url, value);
+        }
+    }
+    return url;
+}
+
+void add_route_limits(query_executor &executor)
+{
+    // Queries run on their own threads, point lookups before scans. Scans may only take half of them and
+    // a few may wait, more are turned away so they cannot hold up every web server thread.
+    const size_t threads = executor.size();
+    for (const char *route : {"/find", "/prefix", "/by_size", "/by_date"}) {
+        executor.add_route(route, query_class::lookup, threads, 16 * threads);
+    }
+    executor.add_route("/match", query_class::scan, max<size_t>(1, threads / 2), threads);
+    executor.add_route("/dupes", query_class::scan, 2, threads);
+    executor.add_route("/content_dupes", query_class::scan, 2, threads);
+    executor.add_route("/stats", query_class::scan, 2, threads);
+}
+
+void add_routes(crow::App<> &app, shard_set &shards, query_sessions &sessions, query_executor &executor,
+                const static_asset &index_html)
+{
+    add_metric_callbacks(shards, executor);
+
+    // runs the handler of route on the query executor, or answers 503 if too many of its queries wait.
+    // Large responses are compressed there too. The handler records the number of results it sends,
+    // parameters it cannot parse are answered with 400.
+    auto queued = [&](const char *route, auto handler) {
+        return [&executor, route, handler, metrics = route_metrics(route)](const crow::request &req) {
+            timer latency;
+            auto res = executor.run(route, [&] {
+                crow::response res;
+                try {
+                    res = handler(req, metrics);
+                } catch (const std::logic_error &e) {
+                    return crow::response(400, string(e.what()) + "\n");
+                }
+                compress_response(req, res);
+                return res;
+            });
+            if (!res) {
+                res = crow::response(503, "too many queries waiting, try again later\n");
+                res->set_header("Retry-After", "1");
+            }
+            metrics.requests.add();
+            if (res->code >= 400) {
+                metrics.errors.add();
+            }
+            metrics.latency.observe(static_cast<uint64_t>(latency.stop() * 1e6));
+            return std::move(*res);
+        };
+    };
+
+    CROW_ROUTE(app, "/")
+    ([&](const crow::request &req) {
+        return asset_response(req, index_html);
+    });
+
+    CROW_ROUTE(app, "/status")
+    ([&]{
+        const auto versions = shards.current();
+        ostringstream ss;
+        ss << "entries: " << shards.entries(versions) << endl;
+        for (size_t s = 0; s < shards.size(); s++) {
+            const auto cache = shards[s].cache_stats();
+            ss << "shard " << shards[s].name_ << ": " << versions[s]->nodes.size() << " entries, result cache "
+               << cache.entries << " entries, " << cache.bytes / 1024 << " KiB, hits: " << cache.hits
+               << ", misses: " << cache.misses << " (of which refined: " << cache.refinements << ")" << endl;
+        }
+        ss << "resident memory (MiB): " << resident_memory_kilobyte() / 1024 << endl;
+        for (const auto &route : executor.stats()) {
+            ss << route.route << (route.priority == query_class::lookup ? " (lookup)" : " (scan)")
+               << ": running " << route.running << ", queued " << route.queued << ", completed " << route.completed
+               << ", rejected " << route.rejected << ", wait ms p50 < " << route.wait_p50_ms << ", p99 < "
+               << route.wait_p99_ms << ", max " << route.wait_max_ms << endl;
+        }
+        return crow::response{ss.str()};
+    });
+
+    CROW_ROUTE(app, "/metrics")
+    ([&]{
+        crow::response res(default_metrics().render());
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
+    });
+
+    // reads the index file of the shard named in the body again, e.g. after index.ksh crawled it anew;
+    // the other shards, and this one until it is done, keep serving
+    CROW_ROUTE(app, "/reload")
+        .methods("POST"_method)
+    ([&](const crow::request &req) {
+        std::vector<std::string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        const size_t shard = shards.find(body[0]);
+        if (shard == shards.size()) {
+            return crow::response(404, "no shard named " + body[0] + "\n");
+        }
+        timer s;
+        try {
+            shards[shard].reload();
+        } catch (const std::exception &e) {
+            return crow::response(500, "reloading " + body[0] + " failed: " + e.what() + "\n");
+        }
+        ostringstream ss;
+        ss << "shard " << body[0] << ": " << shards[shard].current()->nodes.size()
+           << " entries, elapsed seconds: " << s.stop() << endl;
+        return crow::response{ss.str()};
+    });
+
+    // pages of at most the number of results, ?cursor= continues after the previous page (see the
+    // next page link or "next" in the JSON output)
+    CROW_ROUTE(app, "/find")
+        .methods("POST"_method)
+    (queued("/find", [&](const crow::request &req, const route_metrics &metrics) {
+        const auto versions = shards.current();
+        std::vector<std::string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        const auto format = result_format_of(req.url_params.get("format"));
+        const auto cursor = entry_cursor::parse(req.url_params.get("cursor"));
+        const auto accessed = accessed_range(req);
+        crow::response res;
+        result_writer results(res.body, format);
+        string next;
+        if (body.size() > 1) {
+            size_t max_results = std::stoll(body[1]);
+            shard_hit last_written{0, no_node};
+            bool found = false;
+            // the entries of a basename are in shard order, a page continues from one shard in the next;
+            // a page of no results has no entry to continue after, like with /by_size
+            for (uint32_t s = 0; s < versions.size() && next.empty() && max_results > 0; s++) {
+                const auto &index = versions[s];
+                const size_t run = index->basenames.find(index->nodes, body[0]);
+                if (run == basename_dictionary::npos) {
+                    continue;
+                }
+                found = true;
+                const node_id last = index->basenames.last(run);
+                const auto shard_cursor = cursor.in_shard(s);
+                for (node_id id = shard_cursor.seek(index->nodes, index->basenames.first(run), last); id < last; id++) {
+                    if ((id = index->times.skip(id, last, accessed)) == last) {
+                        break;
+                    }
+                    const auto node = index->nodes[id];
+                    if (!accessed.contains(node.atime())) {
+                        continue;
+                    }
+                    const auto file = node.file();
+                    bool excluded = false;
+                    for (size_t i = 2; i < body.size() && !excluded; i++) {
+                        excluded = !body[i].empty() && file.find(body[i]) != std::string::npos;
+                    }
+                    if (excluded) {
+                        continue; // skip this one
+                    }
+                    if (results.rows() >= max_results) {
+                        next = with_accessed_range(
+                            next_page_url("/find",
+                                          entry_cursor::at(versions[last_written.shard]->nodes[last_written.id],
+                                                           last_written.shard),
+                                          format),
+                            req);
+                        break;
+                    }
+                    results.write(node);
+                    last_written = {s, id};
+                }
+            }
+            static counter &hits = index_lookups("/find", "hit"), &misses = index_lookups("/find", "miss");
+            (found ? hits : misses).add();
+        }
+        results.finish(next);
+        metrics.results.observe(results.rows());
+        if (format == result_format::json) {
+            res.set_header("Content-Type", "application/json");
+        }
+        return res;
+    }));
+
+    // type-ahead: distinct basenames starting with the given prefix, in lexicographic order, one per
+    // line followed by a tab and the number of entries with that basename
+    CROW_ROUTE(app, "/prefix")
+        .methods("POST"_method)
+    (queued("/prefix", [&](const crow::request &req, const route_metrics &metrics) {
+        const auto versions = shards.current();
+        std::vector<std::string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        ostringstream ss;
+        if (!body[0].empty()) {
+            const size_t max_results = body.size() > 1 && !body[1].empty() ? std::stoll(body[1]) : 10;
+            std::vector<std::pair<size_t, size_t>> runs;
+            bool found = false;
+            for (const auto &index : versions) {
+                runs.push_back(index->basenames.prefix(index->nodes, body[0]));
+                found = found || runs.back().first != runs.back().second;
+            }
+            static counter &hits = index_lookups("/prefix", "hit"), &misses = index_lookups("/prefix", "miss");
+            (found ? hits : misses).add();
+            // the next basename is the least of the next ones of all shards, counted in every shard that has it
+            size_t rows = 0;
+            for (; rows < max_results; rows++) {
+                std::string_view name;
+                found = false;
+                for (size_t s = 0; s < versions.size(); s++) {
+                    if (runs[s].first < runs[s].second) {
+                        const auto candidate = versions[s]->basenames.name(versions[s]->nodes, runs[s].first);
+                        if (!found || candidate < name) {
+                            name = candidate;
+                            found = true;
+                        }
+                    }
+                }
+                if (!found) {
+                    break;
+                }
+                size_t count = 0;
+                for (size_t s = 0; s < versions.size(); s++) {
+                    const auto &basenames = versions[s]->basenames;
+                    if (runs[s].first < runs[s].second && basenames.name(versions[s]->nodes, runs[s].first) == name) {
+                        count += basenames.last(runs[s].first) - basenames.first(runs[s].first);
+                        runs[s].first++;
+                    }
+                }
+                ss << name << '\t' << count << endl;
+            }
+            metrics.results.observe(rows);
+        }
+        return crow::response{ss.str()};
+    }));
+
+    CROW_ROUTE(app, "/match")
+        .methods("POST"_method)
+    (queued("/match", [&](const crow::request &req, const route_metrics &metrics) {
+        const auto versions = shards.current();
+        std::vector<std::string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        const auto format = result_format_of(req.url_params.get("format"));
+        const auto cursor = entry_cursor::parse(req.url_params.get("cursor"));
+        const auto query = sessions.begin(req.url_params.get("session"), req.url_params.get("generation"));
+        const auto accessed = accessed_range(req);
+        crow::response res;
+        if (body.size() > 1) {
+            size_t max_results = std::stoll(body[1]);
+
+            const bool only_folders = req.url_params.get("only_folders") != nullptr;
+            //  ss << "matching " << req.body << endl;
+            result_writer results(res.body, format);
+            // every shard finds its first max_results matches, at the same time, the page is the first of all
+            std::vector<shard_hits> hits(versions.size());
+            parallel_for(default_pool(), versions.size(), [&](size_t s) {
+                const auto &index = versions[s];
+                const auto shard_cursor = cursor.in_shard(static_cast<uint32_t>(s));
+                auto accept = [&](const node &node) {
+                    if (only_folders && node.filetype() != 'd')
+                        return false;
+                    if (!accessed.contains(node.atime()))
+                        return false;
+                    if (!shard_cursor.before(node))
+                        return false; // sent on an earlier page
+
+                    const auto file = node.file();
+                    for (size_t i = 2; i < body.size(); i++) {
+                        if (!body[i].empty() && file.find(body[i]) != std::string::npos) {
+                            return false; // skip this one
+                        }
+                    }
+                    return true;
+                };
+                auto &ids = hits[s].ids;
+                const auto matches = body[0].size() >= 3 ? shards[s].match(index, body[0], query) : nullptr;
+                // answered from the (cached) matches, by looking up the trigrams or by scanning all basenames
+                static counter &from_matches = index_lookups("/match", "matches"),
+                               &from_trigrams = index_lookups("/match", "trigrams"),
+                               &from_scan = index_lookups("/match", "scan");
+                (matches && matches->complete ? from_matches : body[0].size() >= 3 ? from_trigrams : from_scan).add();
+                if (matches && matches->complete) {
+                    const auto &all = matches->ids;
+                    auto from = std::partition_point(all.begin(), all.end(), [&](node_id id) {
+                        return !shard_cursor.before(index->nodes[id]);
+                    });
+                    for (auto id = from; id != all.end() && ids.size() < max_results; ++id) {
+                        if ((id - from) % 1024 == 1023 && query.cancelled()) {
+                            break;
+                        }
+                        if (accept(index->nodes[*id])) {
+                            ids.push_back(*id);
+                        }
+                    }
+                } else if (body[0].size() >= 3) {
+                    index->trigrams.find(index->nodes, index->basenames, body[0], [&](node_id first, node_id last) {
+                        if (query.cancelled()) {
+                            return false;
+                        }
+                        for (node_id id = shard_cursor.seek(index->nodes, first, last); id < last; id++) {
+                            if ((id = index->times.skip(id, last, accessed)) == last) {
+                                break;
+                            }
+                            if (accept(index->nodes[id])) {
+                                ids.push_back(id);
+                                if (ids.size() >= max_results) {
+                                    return false;
+                                }
+                            }
+                        }
+                        return true;
+                    });
+                } else {
+                    // too short for the trigram index, scan all basenames in parallel
+                    ids = scan_basenames(index->nodes, body[0], max_results, accept, query);
+                }
+                hits[s].complete = ids.size() >= max_results || !query.cancelled();
+            });
+            if (query.superseded()) {
+                return crow::response(409, "superseded by a newer query of the session\n");
+            }
+            const auto page = merge_hits(hits, max_results, [&](shard_hit lhs, shard_hit rhs) {
+                return shard_entry_less(versions, lhs, rhs);
+            });
+            for (const auto &hit : page) {
+                results.write(versions[hit.shard]->nodes[hit.id]);
+            }
+            // past the deadline, what was found so far is sent with a link to continue after it
+            const bool expired = query.expired();
+            if (expired && page.empty()) {
+                return crow::response(503, "query deadline exceeded\n");
+            }
+            string next;
+            if ((results.rows() >= max_results || expired) && !page.empty()) {
+                const auto last = page.back();
+                next = with_accessed_range(
+                    next_page_url("/match", entry_cursor::at(versions[last.shard]->nodes[last.id], last.shard), format),
+                    req);
+                if (only_folders) {
+                    next += "&only_folders";
+                }
+            }
+            results.finish(next);
+            metrics.results.observe(results.rows());
+        }
+        if (format == result_format::json) {
+            res.set_header("Content-Type", "application/json");
+        }
+        return res;
+    }));
+
+    // duplicate directories within and across shards
+    CROW_ROUTE(app, "/dupes")
+        .methods("POST"_method)
+    (queued("/dupes", [&](const crow::request &req, const route_metrics &metrics) {
+        const auto dupes = shards.dupes();
+        const auto &versions = dupes->versions();
+        std::vector<std::string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        ostringstream ss;
+        timer s6;
+        const size_t groups = dupes->count_at_least(std::stoull(body[0]) * 1024);
+        // pages of limit groups, the number of results field of the page sets the page size
+        const size_t limit = body.size() > 1 && !body[1].empty() ? std::stoull(body[1]) : 100;
+        const char *offset_param = req.url_params.get("offset");
+        const size_t offset = std::min<size_t>(offset_param ? std::stoull(offset_param) : 0, groups);
+        metrics.results.observe(std::min(groups, offset + limit) - offset);
+        if (result_format_of(req.url_params.get("format")) == result_format::json) {
+            crow::response res;
+            res.body = "{\"groups\":[";
+            for (size_t group = offset; group < std::min(groups, offset + limit); group++) {
+                res.body += group > offset ? ",\n{\"hash\":\"" : "\n{\"hash\":\"";
+                res.body += dupes->hash(group).str() + "\",\"kilobyte\":" +
+                            std::to_string(dupes->cum_kilobyte(group)) + ",\"members\":[";
+                bool first = true;
+                for (const auto &member : dupes->members(group)) {
+                    const auto node = versions[member.shard]->nodes[member.id];
+                    res.body += first ? "{\"file\":" : ",{\"file\":";
+                    first = false;
+                    append_json_string(res.body, node.file());
+                    res.body += ",\"files\":" + std::to_string(node.file_count()) + "}";
+                }
+                res.body += "]}";
+            }
+            res.body += "],\n\"next\":" + (offset + limit < groups
+                                               ? "\"/dupes?offset=" + std::to_string(offset + limit) + "&format=json\""
+                                               : string("null")) + "}\n";
+            res.set_header("Content-Type", "application/json");
+            return res;
+        }
+        for (size_t group = offset; group < std::min(groups, offset + limit); group++) {
+            const auto members = dupes->members(group);
+            ss << "hash " << dupes->hash(group) << " occurs " << members.size() << " times..." << endl;
+            for (const auto &member : members) {
+                const auto node = versions[member.shard]->nodes[member.id];
+                ss << "  - " << node.file() << " (" << (dupes->cum_kilobyte(group) / 1024) << " MiB, "
+                   << node.file_count() << " files)" << endl;
+            }
+        }
+        if (offset + limit < groups) {
+            ss << "Showing groups " << offset << " to " << (offset + limit) << " of " << groups
+               << ", next page: /dupes?offset=" << (offset + limit) << endl;
+        }
+        cout << "listing all duplicate folders > 1GiB..\n";
+        cout << "elapsed seconds: " << s6.stop() << endl;
+        return crow::response{ss.str()};
+    }));
+
+    // duplicate file contents, found within every shard; groups of all shards by size
+    CROW_ROUTE(app, "/content_dupes")
+        .methods("POST"_method)
+    (queued("/content_dupes", [&](const crow::request &req, const route_metrics &metrics) {
+        std::vector<std::string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        ostringstream ss;
+        std::vector<std::shared_ptr<const std::vector<content_dupes::group>>> shard_groups;
+        for (size_t s = 0; s < shards.size(); s++) {
+            shard_groups.push_back(shards[s].content.groups());
+            if (!shard_groups.back()) {
+                metrics.results.observe(0);
+                ss << "Duplicate file contents are not known yet (" << shards[s].name_ << ": "
+                   << shards[s].content.status() << ")" << endl;
+                return crow::response{ss.str()};
+            }
+        }
+        const uint64_t min_size = std::stoull(body[0]) * 1024 * 1024;
+        // (shard, group), largest first like the groups of every shard
+        std::vector<std::pair<uint32_t, const content_dupes::group *>> groups;
+        for (uint32_t s = 0; s < shard_groups.size(); s++) {
+            for (const auto &group : *shard_groups[s]) {
+                if (group.size < min_size) {
+                    break;
+                }
+                groups.emplace_back(s, &group);
+            }
+        }
+        std::stable_sort(groups.begin(), groups.end(), [](const auto &lhs, const auto &rhs) {
+            return lhs.second->size > rhs.second->size;
+        });
+        const size_t matching = groups.size();
+        const size_t limit = body.size() > 1 && !body[1].empty() ? std::stoull(body[1]) : 100;
+        const char *offset_param = req.url_params.get("offset");
+        const size_t offset = std::min<size_t>(offset_param ? std::stoull(offset_param) : 0, matching);
+        metrics.results.observe(std::min(matching, offset + limit) - offset);
+        if (result_format_of(req.url_params.get("format")) == result_format::json) {
+            crow::response res;
+            res.body = "{\"groups\":[";
+            for (size_t i = offset; i < std::min(matching, offset + limit); i++) {
+                const auto &group = *groups[i].second;
+                const auto index = shards[groups[i].first].content_version();
+                res.body += i > offset ? ",\n{\"hash\":\"" : "\n{\"hash\":\"";
+                res.body += group.hash.str() + "\",\"size\":" + std::to_string(group.size) + ",\"members\":[";
+                for (size_t m = 0; m < group.members.size(); m++) {
+                    res.body += m ? "," : "";
+                    append_json_string(res.body, index->nodes[group.members[m]].file());
+                }
+                res.body += "]}";
+            }
+            res.body += "],\n\"next\":" + (offset + limit < matching
+                                               ? "\"/content_dupes?offset=" + std::to_string(offset + limit) + "&format=json\""
+                                               : string("null")) + "}\n";
+            res.set_header("Content-Type", "application/json");
+            return res;
+        }
+        for (size_t i = offset; i < std::min(matching, offset + limit); i++) {
+            const auto &group = *groups[i].second;
+            const auto index = shards[groups[i].first].content_version();
+            ss << "hash " << group.hash << " occurs " << group.members.size() << " times..." << endl;
+            for (node_id id : group.members) {
+                ss << "  - " << index->nodes[id].file() << " (" << (group.size / 1024 / 1024) << " MiB)" << endl;
+            }
+        }
+        if (offset + limit < matching) {
+            ss << "Showing groups " << offset << " to " << (offset + limit) << " of " << matching
+               << ", next page: /content_dupes?offset=" << (offset + limit) << endl;
+        }
+        return crow::response{ss.str()};
+    }));
+
+    CROW_ROUTE(app, "/by_size")
+        .methods("POST"_method)
+    (queued("/by_size", [&](const crow::request &req, const route_metrics &metrics) {
+        const auto versions = shards.current();
+        std::vector<std::string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        const auto format = result_format_of(req.url_params.get("format"));
+        const auto cursor = entry_cursor::parse(req.url_params.get("cursor"));
+        const auto accessed = accessed_range(req);
+        const size_t limit = body.size() > 1 && !body[1].empty() ? std::stoull(body[1]) : 100;
+        crow::response res;
+        timer s6;
+        // one entry more than fits on the page tells whether there is a next one
+        std::vector<shard_hits> hits(versions.size());
+        for (uint32_t s = 0; s < versions.size(); s++) {
+            const auto &index = versions[s];
+            const auto shard_cursor = cursor.in_shard(s);
+            const auto &by_size = index->nodes_by_size;
+            auto pos = std::partition_point(by_size.begin(), by_size.end(), [&](node_id id) {
+                return !shard_cursor.before_by_size(index->nodes[id]);
+            });
+            for (; pos != by_size.end() && hits[s].ids.size() <= limit; ++pos) {
+                if (accessed.contains(index->nodes[*pos].atime())) {
+                    hits[s].ids.push_back(*pos);
+                }
+            }
+        }
+        auto page = merge_hits(hits, limit + 1, [&](shard_hit lhs, shard_hit rhs) {
+            return shard_larger_first(versions, lhs, rhs);
+        });
+        string next;
+        if (page.size() > limit && limit > 0) {
+            page.resize(limit);
+            next = with_accessed_range(
+                next_page_url("/by_size", entry_cursor::at(versions[page.back().shard]->nodes[page.back().id], page.back().shard),
+                              format),
+                req);
+        }
+        page.resize(std::min(page.size(), limit));
+        metrics.results.observe(page.size());
+        if (format == result_format::json) {
+            result_writer results(res.body, format);
+            for (const auto &hit : page) {
+                results.write(versions[hit.shard]->nodes[hit.id]);
+            }
+            results.finish(next);
+            res.set_header("Content-Type", "application/json");
+        } else {
+            for (const auto &hit : page) {
+                const auto node = versions[hit.shard]->nodes[hit.id];
+                res.body += "match: " + std::to_string(node.kilobyte() / 1024) + "MiB " + node.file() + "\n";
+            }
+            if (!next.empty()) {
+                res.body += "<a class=\"next_page\" href=\"";
+                append_html_escaped(res.body, next);
+                res.body += "\">next page</a>\n";
+            }
+        }
+        cout << "elapsed seconds: " << s6.stop() << endl;
+        return res;
+    }));
+
+    // most recently accessed entries first, in the access time range of the request; a date in the
+    // term (see time_range::parse_time()) lists the entries accessed before it
+    CROW_ROUTE(app, "/by_date")
+        .methods("POST"_method)
+    (queued("/by_date", [&](const crow::request &req, const route_metrics &metrics) {
+        const auto versions = shards.current();
+        std::vector<std::string> body;
+        boost::split(body, req.body, boost::is_any_of("\r\n "), boost::token_compress_on);
+        const auto format = result_format_of(req.url_params.get("format"));
+        const auto cursor = entry_cursor::parse(req.url_params.get("cursor"));
+        auto accessed = accessed_range(req);
+        if (!body[0].empty()) {
+            accessed.before = std::min(accessed.before, time_range::parse_time(body[0], local_now()));
+        }
+        const size_t limit = body.size() > 1 && !body[1].empty() ? std::stoull(body[1]) : 100;
+        // the range is a slice of nodes_by_atime, only its start and the end of the page are searched; one
+        // entry more than fits on the page tells whether there is a next one
+        std::vector<shard_hits> hits(versions.size());
+        for (uint32_t s = 0; s < versions.size(); s++) {
+            const auto &index = versions[s];
+            const auto shard_cursor = cursor.in_shard(s);
+            const auto &by_atime = index->nodes_by_atime;
+            auto pos = std::partition_point(by_atime.begin(), by_atime.end(), [&](node_id id) {
+                const auto node = index->nodes[id];
+                return !shard_cursor.before_by_atime(node) || (!accessed.unbounded() && node.atime() >= accessed.before);
+            });
+            const auto end = accessed.unbounded() ? by_atime.end() : std::partition_point(pos, by_atime.end(), [&](node_id id) {
+                return accessed.contains(index->nodes[id].atime());
+            });
+            hits[s].ids.assign(pos, pos + static_cast<ptrdiff_t>(std::min<size_t>(limit + 1, end - pos)));
+        }
+        auto page = merge_hits(hits, limit + 1, [&](shard_hit lhs, shard_hit rhs) {
+            return shard_newer_first(versions, lhs, rhs);
+        });
+        string next;
+        if (page.size() > limit && limit > 0) {
+            page.resize(limit);
+            next = with_accessed_range(
+                next_page_url("/by_date", entry_cursor::at(versions[page.back().shard]->nodes[page.back().id], page.back().shard),
+                              format),
+                req);
+        }
+        page.resize(std::min(page.size(), limit));
+        metrics.results.observe(page.size());
+        crow::response res;
+        result_writer results(res.body, format);
+        for (const auto &hit : page) {
+            results.write(versions[hit.shard]->nodes[hit.id]);
+        }
+        results.finish(next);
+        if (format == result_format::json) {
+            res.set_header("Content-Type", "application/json");
+        }
+        return res;
+    }));
+
+    // Sums over all shards, e.g. /stats?group_by=extension,age&under=/mnt2/NAS&type=f for the space used by
+    // files below /mnt2/NAS per extension and age. group_by takes any of extension, age, type and subtree
+    // (the directories right below under); without it there is one group, the total. ?accessed_after= and
+    // ?accessed_before= limit it to entries accessed in that time, like for the other routes. One line per
+    // group, largest first, at most ?limit= (default 100) of them.
+    CROW_ROUTE(app, "/stats")
+    (queued("/stats", [&](const crow::request &req, const route_metrics &metrics) {
+        const auto versions = shards.current();
+        stats_query query;
+        const char *group_by = req.url_params.get("group_by");
+        const char *under = req.url_params.get("under");
+        const char *type = req.url_params.get("type");
+        const char *limit_param = req.url_params.get("limit");
+        const size_t limit = limit_param ? std::stoull(limit_param) : 100;
+        const auto format = result_format_of(req.url_params.get("format"));
+        timer s;
+        stats_result stats;
+        try {
+            if (group_by && *group_by) {
+                std::vector<std::string> keys;
+                boost::split(keys, group_by, boost::is_any_of(","));
+                for (const auto &key : keys) {
+                    query.group_by.push_back(parse_stats_key(key));
+                }
+            }
+            query.under = under ? under : "";
+            query.filetype = type ? type[0] : 0;
+            query.accessed = accessed_range(req);
+            // every shard is aggregated on all of the pool, then their groups are added up
+            std::vector<stats_result> parts;
+            for (const auto &index : versions) {
+                parts.push_back(stats_aggregation(*index, query).run());
+            }
+            stats = merge_stats(parts);
+        } catch (const std::exception &e) {
+            return crow::response(400, string(e.what()) + "\n");
+        }
+        const double seconds = s.stop();
+        const size_t shown = std::min(limit, stats.groups.size());
+        metrics.results.observe(shown);
+        crow::response res;
+        if (format == result_format::json) {
+            res.body = "{\"group_by\":[";
+            for (size_t k = 0; k < query.group_by.size(); k++) {
+                res.body += k ? ",\"" : "\"";
+                res.body += string(stats_key_name(query.group_by[k])) + "\"";
+            }
+            res.body += "],\"groups\":[";
+            for (size_t i = 0; i < shown; i++) {
+                const auto &group = stats.groups[i];
+                res.body += i ? ",\n{\"key\":[" : "\n{\"key\":[";
+                for (size_t k = 0; k < group.key.size(); k++) {
+                    res.body += k ? "," : "";
+                    append_json_string(res.body, group.key[k]);
+                }
+                res.body += "],\"entries\":" + std::to_string(group.entries) +
+                            ",\"kilobyte\":" + std::to_string(group.kilobyte) + "}";
+            }
+            res.body += "],\n\"groups_total\":" + std::to_string(stats.groups.size()) +
+                        ",\"entries\":" + std::to_string(stats.entries) +
+                        ",\"kilobyte\":" + std::to_string(stats.kilobyte) +
+                        ",\"seconds\":" + std::to_string(seconds) + "}\n";
+            res.set_header("Content-Type", "application/json");
+            return res;
+        }
+        for (auto key : query.group_by) {
+            res.body += string(stats_key_name(key)) + "\t";
+        }
+        res.body += "entries\tMiB\n";
+        for (size_t i = 0; i < shown; i++) {
+            const auto &group = stats.groups[i];
+            for (const auto &value : group.key) {
+                res.body += value + "\t";
+            }
+            res.body += std::to_string(group.entries) + "\t" + std::to_string(group.kilobyte / 1024) + "\n";
+        }
+        res.body += "total: " + std::to_string(stats.entries) + " entries, " + std::to_string(stats.kilobyte / 1024) +
+                    " MiB in " + std::to_string(stats.groups.size()) + " groups, elapsed seconds: " +
+                    std::to_string(seconds) + "\n";
+        return res;
+    }));
+}
@@ -0,0 +1,25 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "crow.h"
+#include "shard_set.h"
+#include "query_context.h"
+#include "query_executor.h"
+#include "compression.h"
+
+// gzips responses from this size on for clients that accept it, smaller ones are not worth the time
+void compress_response(const crow::request &req, crow::response &res);
+
+// asset, or 304 if the client has this version of it already
+crow::response asset_response(const crow::request &req, const static_asset &asset);
+
+// how many queries of each route may run and wait on executor
+void add_route_limits(query_executor &executor);
+
+// index.html, /status, /reload and the query routes over all shards, which run on executor
+void add_routes(crow::App<> &app, shard_set &shards, query_sessions &sessions, query_executor &executor,
+                const static_asset &index_html);
@@ -0,0 +1,216 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string_view>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define INDEXER_SCAN_X86 1
+#endif
+
+#include "node_store.h"
+#include "thread_pool.h"
+#include "query_context.h"
+#include "metrics.h"
+
+// Brute force substring search over all basenames, for terms the trigram index cannot answer.
+//
+// The basename arena is split into partitions of consecutive entries that are scanned on a thread pool.
+// Within a partition, positions whose first and last byte both match the term are found 16 or 32 at a
+// time, only those candidates are mapped back to their entry and verified.
+
+// writes the positions i in [0, count) with p[i] == first && p[i + gap] == last to out
+using candidate_filter = size_t (*)(const char *p, size_t count, size_t gap, char first, char last, uint32_t *out);
+
+inline size_t candidates_scalar(const char *p, size_t count, size_t gap, char first, char last, uint32_t *out)
+{
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (p[i] == first && p[i + gap] == last) {
+            out[found++] = static_cast<uint32_t>(i);
+        }
+    }
+    return found;
+}
+
+#ifdef INDEXER_SCAN_X86
+__attribute__((target("sse2")))
+inline size_t candidates_sse2(const char *p, size_t count, size_t gap, char first, char last, uint32_t *out)
+{
+    const __m128i f = _mm_set1_epi8(first);
+    const __m128i l = _mm_set1_epi8(last);
+    size_t found = 0, i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + gap));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, f), _mm_cmpeq_epi8(b, l))));
+        while (mask) {
+            out[found++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    const size_t tail = candidates_scalar(p + i, count - i, gap, first, last, out + found);
+    for (size_t j = found; j < found + tail; j++) {
+        out[j] += static_cast<uint32_t>(i);
+    }
+    return found + tail;
+}
+
+__attribute__((target("avx2")))
+inline size_t candidates_avx2(const char *p, size_t count, size_t gap, char first, char last, uint32_t *out)
+{
+    const __m256i f = _mm256_set1_epi8(first);
+    const __m256i l = _mm256_set1_epi8(last);
+    size_t found = 0, i = 0;
+    for (; i + 32 <= count; i += 32) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + gap));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, f), _mm256_cmpeq_epi8(b, l))));
+        while (mask) {
+            out[found++] = static_cast<uint32_t>(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    const size_t tail = candidates_sse2(p + i, count - i, gap, first, last, out + found);
+    for (size_t j = found; j < found + tail; j++) {
+        out[j] += static_cast<uint32_t>(i);
+    }
+    return found + tail;
+}
+#endif
+
+// widest filter the cpu supports, chosen once
+inline candidate_filter best_filter()
+{
+#ifdef INDEXER_SCAN_X86
+    static const candidate_filter filter = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return &candidates_avx2;
+        }
+        return &candidates_sse2;
+    }();
+    return filter;
+#else
+    return &candidates_scalar;
+#endif
+}
+
+// Returns the ids of (at most max_results) entries whose basename contains term and for which accept(node)
+// returns true, in ascending id order, i.e. exactly what a sequential scan would have found. accept is
+// called from pool threads. The basename arena must be in entry order (sort_by_basename()).
+// Once query is cancelled the scan stops, the ids found up to where it stopped the first partition are
+// still returned, in order.
+template <typename Accept>
+std::vector<node_id> scan_basenames(const node_store &nodes, std::string_view term, size_t max_results, Accept accept,
+                                    const query_context &query = query_context(),
+                                    thread_pool &pool = default_pool())
+{
+    const size_t entries_per_partition = 16 * 1024;
+    const size_t num_partitions = (nodes.size() + entries_per_partition - 1) / entries_per_partition;
+    if (max_results == 0 || num_partitions == 0) {
+        return {};
+    }
+    std::vector<std::vector<node_id>> results(num_partitions);
+    std::unique_ptr<std::atomic<size_t>[]> found(new std::atomic<size_t>[num_partitions]);
+    for (size_t i = 0; i < num_partitions; i++) {
+        found[i] = 0;
+    }
+    std::vector<char> cut_short(num_partitions, 0);
+    // a partition is only worth continuing while the ones before it have not filled max_results yet
+    auto still_needed = [&](size_t partition) {
+        if (query.cancelled()) {
+            cut_short[partition] = 1;
+            return false;
+        }
+        size_t total = 0;
+        for (size_t i = 0; i <= partition && total < max_results; i++) {
+            total += found[i].load(std::memory_order_relaxed);
+        }
+        return total < max_results;
+    };
+    auto add = [&](size_t partition, node_id id) {
+        if (accept(nodes[id])) {
+            results[partition].push_back(id);
+            found[partition].fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    static counter &scanned = default_metrics().add_counter(
+        "indexer_scan_bytes_total", "Bytes of basenames scanned by substring searches", metric_label("scan", "basenames"));
+    const std::string_view names = nodes.names();
+    const candidate_filter filter = best_filter();
+    auto scan_partition = [&](size_t partition) {
+        const node_id first = static_cast<node_id>(partition * entries_per_partition);
+        const node_id last = static_cast<node_id>(std::min(nodes.size(), (partition + 1) * entries_per_partition));
+        if (term.empty()) {
+            for (node_id id = first; id < last && (id % 1024 || still_needed(partition)); id++) {
+                add(partition, id);
+            }
+            return;
+        }
+        const size_t gap = term.size() - 1;
+        const uint64_t begin = nodes.name_offset(first);
+        const uint64_t end = nodes.name_offset(last - 1) + nodes[last - 1].basename().size();
+        if (end - begin <= gap) {
+            return;
+        }
+        const size_t block = 4096;
+        uint32_t candidates[block];
+        scanned.add(end - begin);
+        node_id id = first;
+        node_id matched = no_node;
+        for (uint64_t pos = begin; pos + gap < end && still_needed(partition); pos += block) {
+            const size_t count = std::min<uint64_t>(block, end - gap - pos);
+            const size_t n = filter(names.data() + pos, count, gap, term.front(), term.back(), candidates);
+            for (size_t c = 0; c < n; c++) {
+                const uint64_t at = pos + candidates[c];
+                while (id + 1 < last && nodes.name_offset(id + 1) <= at) {
+                    id++;
+                }
+                const auto basename = nodes[id].basename();
+                if (id == matched || at + term.size() > nodes.name_offset(id) + basename.size()) {
+                    continue; // entry already reported, or the match would run into the next basename
+                }
+                if (memcmp(names.data() + at, term.data(), term.size()) == 0) {
+                    matched = id;
+                    add(partition, id);
+                }
+            }
+        }
+    };
+
+    // partitions are handed out in ascending order, so the earliest ones finish first and later ones can
+    // stop as soon as enough results are known
+    std::atomic<size_t> next_partition{0};
+    task_group group(pool);
+    for (size_t i = 0; i < std::min(pool.size(), num_partitions); i++) {
+        group.run([&] {
+            for (size_t partition; (partition = next_partition++) < num_partitions;) {
+                scan_partition(partition);
+            }
+        });
+    }
+    group.wait();
+
+    std::vector<node_id> ids;
+    for (size_t i = 0; i < num_partitions; i++) {
+        const auto &partition = results[i];
+        ids.insert(ids.end(), partition.begin(), partition.begin() + std::min(partition.size(), max_results - ids.size()));
+        if (ids.size() == max_results || cut_short[i]) {
+            break;
+        }
+    }
+    return ids;
+}
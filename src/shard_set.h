@@ -0,0 +1,332 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+
+#include "indexer.h"
+
+// Several index files served together, each an independent shard with its own indexer: built and loaded
+// concurrently, reloaded and watched on its own. Queries take the published version of every shard once,
+// ask each of them and merge the results by the order of the listing, so that a page holds the first
+// results of all shards together. Entries with the same basename in several shards are in shard order.
+
+// the version of every shard a request uses, by shard
+using shard_versions = std::vector<std::shared_ptr<const index_version>>;
+
+struct shard_hit
+{
+    uint32_t shard;
+    node_id id;
+};
+
+// entry order over all shards (see node_store::entry_less), equal basenames in shard order
+inline bool shard_entry_less(const shard_versions &versions, shard_hit lhs, shard_hit rhs)
+{
+    const auto &l = versions[lhs.shard]->nodes, &r = versions[rhs.shard]->nodes;
+    const int order = l[lhs.id].basename().compare(r[rhs.id].basename());
+    if (order != 0 || lhs.shard != rhs.shard) {
+        return order != 0 ? order < 0 : lhs.shard < rhs.shard;
+    }
+    return node_store::entry_less(l, lhs.id, r, rhs.id);
+}
+
+// larger_first() over all shards
+inline bool shard_larger_first(const shard_versions &versions, shard_hit lhs, shard_hit rhs)
+{
+    const auto l = versions[lhs.shard]->nodes[lhs.id].kilobyte(), r = versions[rhs.shard]->nodes[rhs.id].kilobyte();
+    return l != r ? l > r : shard_entry_less(versions, lhs, rhs);
+}
+
+// newer_first() over all shards
+inline bool shard_newer_first(const shard_versions &versions, shard_hit lhs, shard_hit rhs)
+{
+    const auto l = versions[lhs.shard]->nodes[lhs.id].atime(), r = versions[rhs.shard]->nodes[rhs.id].atime();
+    return l != r ? l > r : shard_entry_less(versions, lhs, rhs);
+}
+
+// The hits of one shard, in the order of the listing. An incomplete shard stopped searching (at its
+// deadline) after its last hit, further hits of it are not known.
+struct shard_hits
+{
+    std::vector<node_id> ids;
+    bool complete = true;
+};
+
+// The first limit hits of all shards together in the order of less, which compares shard_hits. Nothing
+// ordered after the last hit of an incomplete shard is taken, the next page continues from there. A shard
+// that found limit hits has all the hits of it that can be among the first limit.
+template <typename Less>
+std::vector<shard_hit> merge_hits(const std::vector<shard_hits> &hits, size_t limit, Less less)
+{
+    bool bounded = false;
+    shard_hit bound{0, no_node};
+    for (uint32_t s = 0; s < hits.size(); s++) {
+        if (hits[s].complete) {
+            continue;
+        }
+        if (hits[s].ids.empty()) {
+            return {};
+        }
+        const shard_hit last{s, hits[s].ids.back()};
+        if (!bounded || less(last, bound)) {
+            bound = last;
+            bounded = true;
+        }
+    }
+    // there are only a few shards, the next hit is the least of their heads
+    std::vector<size_t> next(hits.size(), 0);
+    std::vector<shard_hit> merged;
+    while (merged.size() < limit) {
+        bool found = false;
+        shard_hit best{0, no_node};
+        for (uint32_t s = 0; s < hits.size(); s++) {
+            const shard_hit head{s, next[s] < hits[s].ids.size() ? hits[s].ids[next[s]] : no_node};
+            if (head.id != no_node && (!found || less(head, best))) {
+                best = head;
+                found = true;
+            }
+        }
+        if (!found || (bounded && less(bound, best))) {
+            break;
+        }
+        merged.push_back(best);
+        next[best.shard]++;
+    }
+    return merged;
+}
+
+// Directories with identical tree hashes in any of the shards, like dupe_groups is for one of them. Groups
+// are ordered by subtree size, largest first, and kept together with the versions they were grouped from.
+class shard_dupe_groups
+{
+private:
+    std::vector<hash128> hash_;
+    std::vector<uint64_t> cum_kilobyte_;   // descending
+    std::vector<uint32_t> member_offset_;  // members of group i are members_[member_offset_[i] .. member_offset_[i + 1]>
+    std::vector<shard_hit> members_;
+    shard_versions versions_; // built from, member ids refer to them
+
+public:
+    struct member_range
+    {
+        const shard_hit *first;
+        const shard_hit *last;
+        const shard_hit *begin() const { return first; }
+        const shard_hit *end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+    };
+
+    // A directory can only have a copy in another shard if all of them are compared, within one shard
+    // its dupe_groups are all there is. Every version keeps its directories by tree hash, so the shards are
+    // merged as they are and only hashes found more than once are collected.
+    void build(const shard_versions &versions)
+    {
+        std::vector<std::pair<hash128, shard_hit>> by_hash;
+        if (versions.size() == 1) {
+            const auto &dupes = versions[0]->dupes;
+            for (size_t group = 0; group < dupes.size(); group++) {
+                for (node_id id : dupes.members(group)) {
+                    by_hash.emplace_back(dupes.hash(group), shard_hit{0, id});
+                }
+            }
+        } else {
+            std::vector<size_t> next(versions.size(), 0);
+            auto head = [&](size_t s) {
+                return versions[s]->nodes[versions[s]->dupes.by_hash()[next[s]]].my_hash();
+            };
+            // the shards are taken in order for every hash, and within a shard the ids already are
+            std::vector<std::pair<hash128, shard_hit>> run;
+            for (;;) {
+                bool found = false;
+                hash128 lowest{};
+                for (size_t s = 0; s < versions.size(); s++) {
+                    if (next[s] < versions[s]->dupes.by_hash().size() && (!found || head(s) < lowest)) {
+                        lowest = head(s);
+                        found = true;
+                    }
+                }
+                if (!found) {
+                    break;
+                }
+                run.clear();
+                for (size_t s = 0; s < versions.size(); s++) {
+                    const auto &dirs = versions[s]->dupes.by_hash();
+                    while (next[s] < dirs.size() && head(s) == lowest) {
+                        run.emplace_back(lowest, shard_hit{static_cast<uint32_t>(s), dirs[next[s]++]});
+                    }
+                }
+                if (run.size() > 1) {
+                    by_hash.insert(by_hash.end(), run.begin(), run.end());
+                }
+            }
+        }
+
+        auto cum_kilobyte = [&](size_t i) {
+            const auto hit = by_hash[i].second;
+            return versions[hit.shard]->nodes[hit.id].cum_kilobyte();
+        };
+        const auto groups = group_by_hash(
+            by_hash.size(), [&](size_t i) { return by_hash[i].first; }, cum_kilobyte);
+        hash_.clear();
+        cum_kilobyte_.clear();
+        member_offset_.clear();
+        members_.clear();
+        for (const auto &group : groups) {
+            hash_.push_back(by_hash[group.first].first);
+            cum_kilobyte_.push_back(cum_kilobyte(group.first));
+            member_offset_.push_back(static_cast<uint32_t>(members_.size()));
+            for (size_t i = group.first; i < group.second; i++) {
+                members_.push_back(by_hash[i].second);
+            }
+        }
+        member_offset_.push_back(static_cast<uint32_t>(members_.size()));
+        versions_ = versions;
+    }
+
+    const shard_versions &versions() const { return versions_; }
+
+    size_t size() const { return hash_.size(); }
+    hash128 hash(size_t group) const { return hash_[group]; }
+    uint64_t cum_kilobyte(size_t group) const { return cum_kilobyte_[group]; }
+    member_range members(size_t group) const
+    {
+        return {members_.data() + member_offset_[group], members_.data() + member_offset_[group + 1]};
+    }
+
+    // number of groups of at least kilobyte, they are groups [0, n>
+    size_t count_at_least(uint64_t kilobyte) const
+    {
+        return static_cast<size_t>(std::partition_point(cum_kilobyte_.begin(), cum_kilobyte_.end(),
+                                                        [kilobyte](uint64_t kb) { return kb >= kilobyte; }) -
+                                   cum_kilobyte_.begin());
+    }
+};
+
+class shard_set
+{
+private:
+    std::mutex dupes_mutex_; // held while grouping, so groups of older versions never replace newer ones
+    bool closing_ = false;
+    std::shared_ptr<const shard_dupe_groups> dupes_;
+    std::vector<std::unique_ptr<indexer>> shards_;
+
+    // Groups the duplicate directories of the published versions again, on the thread of the shard that
+    // just published one, the way a shard groups its own with every version it builds. Nothing is grouped
+    // until every shard published a version.
+    void publish_dupes()
+    {
+        std::lock_guard<std::mutex> lock(dupes_mutex_);
+        if (closing_) {
+            return;
+        }
+        const auto versions = current();
+        if (std::find(versions.begin(), versions.end(), nullptr) != versions.end()) {
+            return;
+        }
+        auto dupes = std::make_shared<shard_dupe_groups>();
+        dupes->build(versions);
+        std::atomic_store(&dupes_, std::shared_ptr<const shard_dupe_groups>(std::move(dupes)));
+    }
+
+public:
+    shard_set() = default;
+
+    // the watch threads of the shards may still publish while the first shards are destroyed
+    ~shard_set()
+    {
+        {
+            std::lock_guard<std::mutex> lock(dupes_mutex_);
+            closing_ = true;
+        }
+        shards_.clear();
+    }
+
+    // a shard for an index file, named after the file unless a name is given
+    indexer &add(std::string filename, std::string name = "")
+    {
+        shards_.emplace_back(new indexer(std::move(filename), std::move(name)));
+        shards_.back()->on_publish([this] { publish_dupes(); });
+        return *shards_.back();
+    }
+
+    // "name=file" or just "file", see add()
+    indexer &add_spec(const std::string &spec)
+    {
+        const size_t equals = spec.find('=');
+        return equals == std::string::npos ? add(spec) : add(spec.substr(equals + 1), spec.substr(0, equals));
+    }
+
+    size_t size() const { return shards_.size(); }
+    indexer &operator[](size_t shard) { return *shards_[shard]; }
+    const indexer &operator[](size_t shard) const { return *shards_[shard]; }
+
+    // the shard of that name, or size() if there is none
+    size_t find(const std::string &name) const
+    {
+        for (size_t shard = 0; shard < shards_.size(); shard++) {
+            if (shards_[shard]->name_ == name) {
+                return shard;
+            }
+        }
+        return shards_.size();
+    }
+
+    // Builds or loads every shard with indexer::run(), all at the same time. Their parallel steps share
+    // the default pool, a shard reading its file keeps the cores busy while another one sorts or hashes.
+    void run()
+    {
+        std::vector<std::exception_ptr> errors(shards_.size());
+        std::vector<std::thread> threads;
+        for (size_t shard = 0; shard < shards_.size(); shard++) {
+            threads.emplace_back([this, shard, &errors] {
+                try {
+                    shards_[shard]->run();
+                } catch (...) {
+                    errors[shard] = std::current_exception();
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (const auto &error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    // the published version of every shard, requests take them once and keep using them
+    shard_versions current() const
+    {
+        shard_versions versions;
+        for (const auto &shard : shards_) {
+            versions.push_back(shard->current());
+        }
+        return versions;
+    }
+
+    size_t entries(const shard_versions &versions) const
+    {
+        size_t total = 0;
+        for (const auto &index : versions) {
+            total += index->nodes.size();
+        }
+        return total;
+    }
+
+    // the duplicate directories over all shards, grouped when a shard published its latest version; use
+    // the versions they were grouped from with them. Null until every shard published a version.
+    std::shared_ptr<const shard_dupe_groups> dupes() const { return std::atomic_load(&dupes_); }
+};
@@ -0,0 +1,211 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/stat.h>
+
+#include "column.h"
+#include "mapped_file.h"
+
+// On-disk snapshot of the fully built index: a header, a table of named sections and the raw section
+// contents, each aligned so it can be used in place from a memory mapping.
+//
+// Bump snapshot_version whenever the layout or meaning of a section changes.
+constexpr uint32_t snapshot_version = 12;
+constexpr char snapshot_magic[8] = {'I', 'D', 'X', 'S', 'N', 'A', 'P', '\0'};
+constexpr size_t snapshot_alignment = 64;
+
+// identifies the index file a snapshot was built from
+struct snapshot_input
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t checksum = 0;
+
+    bool operator==(const snapshot_input &other) const
+    {
+        return size == other.size && mtime == other.mtime && checksum == other.checksum;
+    }
+};
+
+struct snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_sections;
+    snapshot_input input;
+};
+
+struct snapshot_section
+{
+    char name[32];
+    uint64_t offset;
+    uint64_t size;
+};
+
+inline uint64_t fnv1a(std::string_view data, uint64_t hash = 14695981039346656037ULL)
+{
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// size and mtime plus a checksum over the first and last MiB, hashing all of a multi-GB index would cost
+// about as much as parsing it
+inline snapshot_input fingerprint(const std::string &filename)
+{
+    struct stat st{};
+    if (::stat(filename.c_str(), &st) == -1) {
+        throw std::runtime_error("cannot stat " + filename + ": " + strerror(errno));
+    }
+    snapshot_input input;
+    input.size = static_cast<uint64_t>(st.st_size);
+    input.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    const size_t sample = 1024 * 1024;
+    std::ifstream file(filename, std::ios::binary);
+    std::string buffer(std::min<uint64_t>(sample, input.size), '\0');
+    file.read(&buffer[0], buffer.size());
+    input.checksum = fnv1a(buffer);
+    if (input.size > sample) {
+        file.seekg(static_cast<std::streamoff>(input.size - sample));
+        file.read(&buffer[0], buffer.size());
+        input.checksum = fnv1a(buffer, input.checksum);
+    }
+    return input;
+}
+
+class snapshot_writer
+{
+private:
+    struct pending
+    {
+        std::string name;
+        const void *data;
+        size_t size;
+    };
+    std::string filename_;
+    snapshot_input input_;
+    std::vector<pending> sections_;
+
+public:
+    snapshot_writer(std::string filename, snapshot_input input)
+        : filename_(std::move(filename)), input_(input) {}
+
+    // the data is only read by commit() and must stay alive until then
+    template <typename T>
+    void add(const std::string &name, const column<T> &col)
+    {
+        add(name, col.data(), col.bytes());
+    }
+
+    template <typename T>
+    void add(const std::string &name, const std::vector<T> &vec)
+    {
+        add(name, vec.data(), vec.size() * sizeof(T));
+    }
+
+    void add(const std::string &name, const void *data, size_t size)
+    {
+        if (name.size() >= sizeof(snapshot_section::name)) {
+            throw std::invalid_argument("snapshot section name too long: " + name);
+        }
+        sections_.push_back({name, data, size});
+    }
+
+    // writes to a temporary file first, so a crash never leaves a truncated snapshot behind
+    void commit()
+    {
+        const std::string tmp = filename_ + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("cannot write " + tmp);
+        }
+        snapshot_header header{};
+        memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+        header.version = snapshot_version;
+        header.num_sections = static_cast<uint32_t>(sections_.size());
+        header.input = input_;
+
+        auto align = [](uint64_t offset) {
+            return (offset + snapshot_alignment - 1) / snapshot_alignment * snapshot_alignment;
+        };
+        std::vector<snapshot_section> table(sections_.size());
+        uint64_t offset = align(sizeof(header) + table.size() * sizeof(snapshot_section));
+        for (size_t i = 0; i < sections_.size(); i++) {
+            memset(table[i].name, 0, sizeof(table[i].name));
+            memcpy(table[i].name, sections_[i].name.data(), sections_[i].name.size());
+            table[i].offset = offset;
+            table[i].size = sections_[i].size;
+            offset = align(offset + sections_[i].size);
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(snapshot_section));
+        const std::string padding(snapshot_alignment, '\0');
+        for (size_t i = 0; i < sections_.size(); i++) {
+            out.write(padding.data(), static_cast<std::streamsize>(table[i].offset - out.tellp()));
+            out.write(static_cast<const char *>(sections_[i].data), static_cast<std::streamsize>(sections_[i].size));
+        }
+        out.close();
+        if (!out || std::rename(tmp.c_str(), filename_.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("cannot write " + filename_);
+        }
+    }
+};
+
+class snapshot_reader
+{
+private:
+    std::shared_ptr<mapped_file> file_;
+    snapshot_header header_{};
+    const snapshot_section *table_ = nullptr;
+
+public:
+    // copy-on-write mapping, so loaded columns can still be modified in memory
+    explicit snapshot_reader(const std::string &filename)
+        : file_(std::make_shared<mapped_file>(filename, true))
+    {
+        if (file_->size() < sizeof(header_)) {
+            throw std::runtime_error("snapshot too small: " + filename);
+        }
+        memcpy(&header_, file_->data(), sizeof(header_));
+        if (memcmp(header_.magic, snapshot_magic, sizeof(header_.magic)) != 0) {
+            throw std::runtime_error("not a snapshot: " + filename);
+        }
+        if (file_->size() < sizeof(header_) + header_.num_sections * sizeof(snapshot_section)) {
+            throw std::runtime_error("snapshot truncated: " + filename);
+        }
+        table_ = reinterpret_cast<const snapshot_section *>(file_->data() + sizeof(header_));
+    }
+
+    const snapshot_header &header() const { return header_; }
+
+    template <typename T>
+    void load(const std::string &name, column<T> &col) const
+    {
+        for (uint32_t i = 0; i < header_.num_sections; i++) {
+            if (name == table_[i].name) {
+                if (table_[i].offset + table_[i].size > file_->size() || table_[i].size % sizeof(T) != 0) {
+                    throw std::runtime_error("snapshot section corrupt: " + name);
+                }
+                col.map(file_, reinterpret_cast<T *>(file_->mutable_data() + table_[i].offset),
+                        table_[i].size / sizeof(T));
+                return;
+            }
+        }
+        throw std::runtime_error("snapshot section missing: " + name);
+    }
+};
@@ -0,0 +1,259 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <zlib.h>
+#ifdef INDEXER_ZSTD
+#include <zstd.h>
+#endif
+
+// Index files may be stored compressed, as gzip or (in builds with INDEXER_ZSTD) zstd. They are read and
+// written as streams: decompressed a block at a time while parsing, compressed while crawling, never held
+// uncompressed as a whole.
+
+enum class stream_compression { none, gzip, zstd };
+
+inline const char *compression_name(stream_compression compression)
+{
+    switch (compression) {
+    case stream_compression::gzip: return "gzip";
+    case stream_compression::zstd: return "zstd";
+    default: return "none";
+    }
+}
+
+// by the magic number data starts with, index files themselves start with a digit
+inline stream_compression compression_of(std::string_view data)
+{
+    if (data.size() >= 2 && data[0] == '\x1f' && data[1] == '\x8b') {
+        return stream_compression::gzip;
+    }
+    if (data.size() >= 4 && data.substr(0, 4) == std::string_view("\x28\xb5\x2f\xfd", 4)) {
+        return stream_compression::zstd;
+    }
+    return stream_compression::none;
+}
+
+// by the extension of a file to write: .gz or .zst, anything else is written as is
+inline stream_compression compression_for(std::string_view filename)
+{
+    auto ends_with = [filename](std::string_view suffix) {
+        return filename.size() > suffix.size() && filename.substr(filename.size() - suffix.size()) == suffix;
+    };
+    return ends_with(".gz") ? stream_compression::gzip
+                            : ends_with(".zst") ? stream_compression::zstd : stream_compression::none;
+}
+
+// Decompresses a gzip or zstd stream in pieces. Concatenated gzip members and zstd frames, as written by
+// appending to a compressed file, are read as one stream.
+class stream_decompressor
+{
+private:
+    stream_compression compression_;
+    z_stream zlib_{};
+#ifdef INDEXER_ZSTD
+    ZSTD_DStream *zstd_ = nullptr;
+#endif
+    bool at_end_ = false;
+
+public:
+    explicit stream_decompressor(stream_compression compression) : compression_(compression)
+    {
+        if (compression_ == stream_compression::gzip) {
+            // 15 bits of window, +32 to detect the gzip or zlib header
+            if (inflateInit2(&zlib_, 15 + 32) != Z_OK) {
+                throw std::runtime_error("inflateInit2 failed");
+            }
+            return;
+        }
+#ifdef INDEXER_ZSTD
+        if (compression_ == stream_compression::zstd) {
+            zstd_ = ZSTD_createDStream();
+            if (!zstd_ || ZSTD_isError(ZSTD_initDStream(zstd_))) {
+                ZSTD_freeDStream(zstd_);
+                throw std::runtime_error("ZSTD_initDStream failed");
+            }
+            return;
+        }
+#endif
+        throw std::runtime_error(std::string("cannot decompress ") + compression_name(compression_) +
+                                 ", this build has no support for it");
+    }
+
+    stream_decompressor(const stream_decompressor &) = delete;
+    stream_decompressor &operator=(const stream_decompressor &) = delete;
+
+    ~stream_decompressor()
+    {
+        if (compression_ == stream_compression::gzip) {
+            inflateEnd(&zlib_);
+        }
+#ifdef INDEXER_ZSTD
+        ZSTD_freeDStream(zstd_);
+#endif
+    }
+
+    // Appends what input decompresses to to out, until out holds at least want bytes or all of the input
+    // is decompressed, and returns how much of the input it used. Pass the rest of the input next time,
+    // it may be empty to take output still held back. Throws std::runtime_error on corrupt input.
+    size_t decompress(std::string_view input, std::string &out, size_t want)
+    {
+        size_t used = 0;
+        while (out.size() < want && !(at_end_ && used == input.size())) {
+            const size_t filled = out.size();
+            out.resize(std::max(want, filled + 64 * 1024));
+            size_t consumed = 0, produced = 0;
+            if (compression_ == stream_compression::gzip) {
+                zlib_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data() + used));
+                zlib_.avail_in = static_cast<uInt>(std::min<size_t>(input.size() - used, 1u << 30));
+                zlib_.next_out = reinterpret_cast<Bytef *>(&out[filled]);
+                zlib_.avail_out = static_cast<uInt>(std::min<size_t>(out.size() - filled, 1u << 30));
+                const uInt avail_in = zlib_.avail_in, avail_out = zlib_.avail_out;
+                const int result = inflate(&zlib_, Z_NO_FLUSH);
+                consumed = avail_in - zlib_.avail_in;
+                produced = avail_out - zlib_.avail_out;
+                if (result == Z_STREAM_END) {
+                    at_end_ = true;
+                    inflateReset(&zlib_); // another member may follow
+                } else if (result != Z_OK && result != Z_BUF_ERROR) {
+                    throw std::runtime_error(std::string("corrupt gzip input: ") + (zlib_.msg ? zlib_.msg : "inflate failed"));
+                } else if (consumed > 0) {
+                    at_end_ = false;
+                }
+            }
+#ifdef INDEXER_ZSTD
+            if (compression_ == stream_compression::zstd) {
+                ZSTD_inBuffer in{input.data() + used, input.size() - used, 0};
+                ZSTD_outBuffer out_buffer{&out[filled], out.size() - filled, 0};
+                const size_t result = ZSTD_decompressStream(zstd_, &out_buffer, &in);
+                if (ZSTD_isError(result)) {
+                    throw std::runtime_error(std::string("corrupt zstd input: ") + ZSTD_getErrorName(result));
+                }
+                consumed = in.pos;
+                produced = out_buffer.pos;
+                if (consumed + produced > 0) {
+                    at_end_ = result == 0; // a frame is complete and flushed
+                }
+            }
+#endif
+            out.resize(filled + produced);
+            used += consumed;
+            if (consumed + produced == 0) {
+                if (used < input.size()) {
+                    throw std::runtime_error(std::string("corrupt ") + compression_name(compression_) + " input");
+                }
+                break; // everything decompressed that the input holds, the rest of the stream is missing
+            }
+        }
+        return used;
+    }
+
+    // true after a complete stream, false if the input so far ends in the middle of one
+    bool at_end() const { return at_end_; }
+};
+
+// Compresses a stream to a file as it is written, gzip at a level that keeps up with a crawl.
+class stream_compressor
+{
+private:
+    stream_compression compression_;
+    FILE *out_;
+    std::string buffer_;
+    z_stream zlib_{};
+#ifdef INDEXER_ZSTD
+    ZSTD_CCtx *zstd_ = nullptr;
+#endif
+
+    void write_out(const char *data, size_t size)
+    {
+        if (size > 0 && fwrite(data, 1, size, out_) != size) {
+            throw std::runtime_error(std::string("cannot write compressed output: ") + strerror(errno));
+        }
+    }
+
+    // feeds data to the compressor; with finish, ends the stream
+    void compress(std::string_view data, bool finish)
+    {
+        if (compression_ == stream_compression::gzip) {
+            zlib_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+            zlib_.avail_in = static_cast<uInt>(data.size());
+            int result;
+            do {
+                zlib_.next_out = reinterpret_cast<Bytef *>(&buffer_[0]);
+                zlib_.avail_out = static_cast<uInt>(buffer_.size());
+                result = deflate(&zlib_, finish ? Z_FINISH : Z_NO_FLUSH);
+                if (result == Z_STREAM_ERROR) {
+                    throw std::runtime_error("deflate failed");
+                }
+                write_out(buffer_.data(), buffer_.size() - zlib_.avail_out);
+            } while (zlib_.avail_out == 0 || (finish && result != Z_STREAM_END));
+            return;
+        }
+#ifdef INDEXER_ZSTD
+        ZSTD_inBuffer in{data.data(), data.size(), 0};
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out{&buffer_[0], buffer_.size(), 0};
+            remaining = ZSTD_compressStream2(zstd_, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(remaining));
+            }
+            write_out(buffer_.data(), out.pos);
+        } while (finish ? remaining != 0 : in.pos < in.size);
+#endif
+    }
+
+public:
+    // writes to out, which stays open; throws std::runtime_error for a compression this build lacks
+    stream_compressor(stream_compression compression, FILE *out) : compression_(compression), out_(out)
+    {
+        buffer_.resize(256 * 1024);
+        if (compression_ == stream_compression::gzip) {
+            if (deflateInit2(&zlib_, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("deflateInit2 failed");
+            }
+            return;
+        }
+#ifdef INDEXER_ZSTD
+        if (compression_ == stream_compression::zstd) {
+            zstd_ = ZSTD_createCCtx();
+            if (!zstd_ || ZSTD_isError(ZSTD_CCtx_setParameter(zstd_, ZSTD_c_compressionLevel, 3))) {
+                ZSTD_freeCCtx(zstd_);
+                throw std::runtime_error("ZSTD_createCCtx failed");
+            }
+            return;
+        }
+#endif
+        throw std::runtime_error(std::string("cannot compress as ") + compression_name(compression_) +
+                                 ", this build has no support for it");
+    }
+
+    stream_compressor(const stream_compressor &) = delete;
+    stream_compressor &operator=(const stream_compressor &) = delete;
+
+    ~stream_compressor()
+    {
+        if (compression_ == stream_compression::gzip) {
+            deflateEnd(&zlib_);
+        }
+#ifdef INDEXER_ZSTD
+        ZSTD_freeCCtx(zstd_);
+#endif
+    }
+
+    void write(std::string_view data) { compress(data, false); }
+
+    // ends the stream, out is complete after this
+    void finish() { compress({}, true); }
+};
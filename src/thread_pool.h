@@ -0,0 +1,210 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// Work-stealing thread pool: every worker has its own deque, it pops its newest task first and steals the
+// oldest task of another worker when it runs dry. Threads waiting for a task_group help out instead of
+// blocking, so parallel loops can be nested.
+class thread_pool
+{
+private:
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wakeup_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_queue_{0};
+    bool stopping_ = false;
+
+    struct worker_identity
+    {
+        const thread_pool *pool = nullptr;
+        size_t index = 0;
+    };
+
+    static worker_identity &current_worker()
+    {
+        static thread_local worker_identity identity;
+        return identity;
+    }
+
+    // index of the queue owned by the calling thread, or SIZE_MAX if it is not one of our workers
+    size_t own_queue() const
+    {
+        const auto &identity = current_worker();
+        return identity.pool == this ? identity.index : SIZE_MAX;
+    }
+
+    bool pop(size_t self, std::function<void()> &task)
+    {
+        for (size_t i = 0; i < queues_.size(); i++) {
+            auto &queue = *queues_[(self + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            pending_--;
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t self)
+    {
+        current_worker() = {this, self};
+        std::function<void()> task;
+        while (true) {
+            if (pop(self, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wakeup_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+            if (stopping_ && pending_ == 0) {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit thread_pool(size_t num_threads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (size_t i = 0; i < num_threads; i++) {
+            queues_.emplace_back(new worker_queue);
+        }
+        for (size_t i = 0; i < num_threads; i++) {
+            threads_.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        wakeup_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    size_t size() const { return threads_.size(); }
+
+    // tasks submitted from a worker go to its own queue, others are spread round robin
+    void submit(std::function<void()> task)
+    {
+        size_t index = own_queue();
+        if (index == SIZE_MAX) {
+            index = next_queue_++ % queues_.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            pending_++;
+        }
+        wakeup_.notify_one();
+    }
+
+    // runs one queued task on the calling thread, returns false if there was nothing to do
+    bool run_one()
+    {
+        std::function<void()> task;
+        const size_t self = own_queue();
+        if (!pop(self == SIZE_MAX ? 0 : self, task)) {
+            return false;
+        }
+        task();
+        return true;
+    }
+};
+
+// set of tasks that can be waited for
+class task_group
+{
+private:
+    thread_pool &pool_;
+    std::atomic<size_t> outstanding_{0};
+    std::mutex mutex_;
+    std::condition_variable done_;
+
+public:
+    explicit task_group(thread_pool &pool) : pool_(pool) {}
+    ~task_group() { wait(); }
+
+    void run(std::function<void()> task)
+    {
+        outstanding_++;
+        pool_.submit([this, task = std::move(task)] {
+            task();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--outstanding_ == 0) {
+                done_.notify_all();
+            }
+        });
+    }
+
+    void wait()
+    {
+        while (outstanding_ > 0) {
+            if (pool_.run_one()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait_for(lock, std::chrono::milliseconds(1), [this] { return outstanding_ == 0; });
+        }
+        // the last task may still be inside its critical section
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+};
+
+inline thread_pool &default_pool()
+{
+    static thread_pool pool;
+    return pool;
+}
+
+// calls f(i) for every i in [0, n) on the pool and waits for all of them
+template <typename F>
+void parallel_for(thread_pool &pool, size_t n, F f)
+{
+    task_group group(pool);
+    for (size_t i = 0; i < n; i++) {
+        group.run([&f, i] { f(i); });
+    }
+    group.wait();
+}
@@ -0,0 +1,266 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <utility>
+#include <tuple>
+#include <limits>
+#include <charconv>
+#include <stdexcept>
+#include <cstdint>
+#include <ctime>
+
+#include "column.h"
+#include "snapshot.h"
+#include "node_store.h"
+#include "thread_pool.h"
+
+// now on the wall clock timestamps in the index were printed in, see parse_timestamp()
+inline int64_t local_now()
+{
+    const time_t now = time(nullptr);
+    tm local{};
+    localtime_r(&now, &local);
+    return (static_cast<int64_t>(now) + local.tm_gmtoff) * 1000000000;
+}
+
+// Access times an entry has to be in for ?accessed_after= and ?accessed_before=: after is inclusive,
+// before exclusive. Entries without an access time are only in the range that has no bounds.
+struct time_range
+{
+    int64_t after = std::numeric_limits<int64_t>::min();
+    int64_t before = std::numeric_limits<int64_t>::max();
+
+    bool unbounded() const
+    {
+        return after == std::numeric_limits<int64_t>::min() && before == std::numeric_limits<int64_t>::max();
+    }
+
+    bool contains(int64_t atime) const
+    {
+        return unbounded() || (atime != no_timestamp && atime >= after && atime < before);
+    }
+
+    // true if no access time in [min, max] can be in the range
+    bool excludes(int64_t min, int64_t max) const { return !unbounded() && (max < after || min >= before); }
+
+    // "2019-02-20", "2019-02-20+01:38:12" like find prints them, or "730d" for 730 days before now (on
+    // the clock of the index, see local_now()); throws std::invalid_argument if param is neither
+    static int64_t parse_time(std::string_view param, int64_t now)
+    {
+        if (!param.empty() && param.back() == 'd') {
+            int64_t days = 0;
+            const auto res = std::from_chars(param.data(), param.data() + param.size() - 1, days);
+            if (res.ec == std::errc() && res.ptr == param.data() + param.size() - 1) {
+                return now - days * 86400 * 1000000000;
+            }
+        }
+        const int64_t time = parse_timestamp(param.size() == 10 ? std::string(param) + "+00:00:00" : std::string(param));
+        if (time == no_timestamp) {
+            throw std::invalid_argument("not a date: " + std::string(param));
+        }
+        return time;
+    }
+
+    static time_range parse(const char *after, const char *before, int64_t now)
+    {
+        time_range range;
+        if (after && *after) {
+            range.after = parse_time(after, now);
+        }
+        if (before && *before) {
+            range.before = parse_time(before, now);
+        }
+        return range;
+    }
+};
+
+// Zone map over the access times: the oldest and newest access time of every block of consecutive
+// entries. Ranges of entries are searched block by block, blocks that cannot hold an entry in the
+// requested time range are skipped without looking at their entries. Blocks are built with block_size
+// entries; updates move their boundaries along with the entries and keep them between half and twice
+// that size.
+class time_index
+{
+private:
+    column<node_id> first_; // first entry of every block, plus the end of the last one
+    column<int64_t> min_;
+    column<int64_t> max_;
+
+    size_t block_of(node_id id) const
+    {
+        return static_cast<size_t>(std::upper_bound(first_.begin(), first_.end() - 1, id) - first_.begin()) - 1;
+    }
+
+    static std::pair<int64_t, int64_t> bounds(const node_store &nodes, node_id first, node_id last)
+    {
+        std::pair<int64_t, int64_t> result{std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min()};
+        for (node_id id = first; id < last; id++) {
+            result.first = std::min(result.first, nodes[id].atime());
+            result.second = std::max(result.second, nodes[id].atime());
+        }
+        return result;
+    }
+
+    // splits blocks that grew beyond twice block_size and joins ones that shrank below half of it with the
+    // block before them, only split blocks are computed again
+    void rebalance(const node_store &nodes)
+    {
+        std::vector<node_id> first;
+        std::vector<int64_t> mins, maxs;
+        bool changed = false;
+        for (size_t block = 0; block + 1 < first_.size(); block++) {
+            const node_id start = first_[block], end = first_[block + 1];
+            if (end - start > 2 * block_size) {
+                changed = true;
+                const size_t pieces = (end - start + block_size - 1) / block_size;
+                for (size_t piece = 0; piece < pieces; piece++) {
+                    const auto piece_first = static_cast<node_id>(start + (end - start) * piece / pieces);
+                    const auto piece_last = static_cast<node_id>(start + (end - start) * (piece + 1) / pieces);
+                    const auto piece_bounds = bounds(nodes, piece_first, piece_last);
+                    first.push_back(piece_first);
+                    mins.push_back(piece_bounds.first);
+                    maxs.push_back(piece_bounds.second);
+                }
+            } else if (!first.empty() && (end - start < block_size / 2 || start - first.back() < block_size / 2) &&
+                       end - first.back() <= 2 * block_size) {
+                changed = true;
+                mins.back() = std::min(mins.back(), min_[block]);
+                maxs.back() = std::max(maxs.back(), max_[block]);
+            } else {
+                first.push_back(start);
+                mins.push_back(min_[block]);
+                maxs.push_back(max_[block]);
+            }
+        }
+        if (!changed) {
+            return;
+        }
+        first.push_back(first_.back());
+        first_.clear();
+        first_.append(first.begin(), first.end());
+        min_.clear();
+        min_.append(mins.begin(), mins.end());
+        max_.clear();
+        max_.append(maxs.begin(), maxs.end());
+    }
+
+public:
+    static constexpr size_t block_size = 4096;
+
+    void build(const node_store &nodes)
+    {
+        const size_t blocks = (nodes.size() + block_size - 1) / block_size;
+        first_.resize(blocks + 1);
+        for (size_t block = 0; block <= blocks; block++) {
+            first_[block] = static_cast<node_id>(std::min(nodes.size(), block * block_size));
+        }
+        min_.assign(blocks, std::numeric_limits<int64_t>::max());
+        max_.assign(blocks, std::numeric_limits<int64_t>::min());
+        parallel_for(default_pool(), blocks, [&](size_t block) {
+            std::tie(min_[block], max_[block]) = bounds(nodes, first_[block], first_[block + 1]);
+        });
+    }
+
+    // After index_version::update() changed the entries. Blocks keep their entries: a block starts at the
+    // new id of its first remaining entry, inserted entries widen the bounds of the block they land in, and
+    // only blocks holding a retimed entry (new ids) are computed again. Bounds can still count an entry that
+    // was deleted from the block, which only means it is skipped less often.
+    void update(const node_store &nodes, const id_remap &remap, const std::vector<node_id> &retimed)
+    {
+        if (first_.size() < 2) {
+            build(nodes);
+            return;
+        }
+        if (remap.renumbers()) {
+            std::vector<node_id> first;
+            std::vector<int64_t> mins, maxs;
+            for (size_t block = 0; block + 1 < first_.size(); block++) {
+                const node_id start = block == 0 ? 0 : remap.lower_bound(first_[block]);
+                const node_id end = remap.lower_bound(first_[block + 1]);
+                if (start < end) {
+                    first.push_back(start);
+                    mins.push_back(min_[block]);
+                    maxs.push_back(max_[block]);
+                }
+            }
+            if (first.empty()) {
+                build(nodes);
+                return;
+            }
+            first.push_back(static_cast<node_id>(nodes.size()));
+            first_.clear();
+            first_.append(first.begin(), first.end());
+            for (node_id id : remap.inserted()) {
+                const size_t block = block_of(id);
+                mins[block] = std::min(mins[block], nodes[id].atime());
+                maxs[block] = std::max(maxs[block], nodes[id].atime());
+            }
+            min_.clear();
+            min_.append(mins.begin(), mins.end());
+            max_.clear();
+            max_.append(maxs.begin(), maxs.end());
+        }
+        std::vector<size_t> blocks;
+        for (node_id id : retimed) {
+            blocks.push_back(block_of(id));
+        }
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+        for (size_t block : blocks) {
+            std::tie(min_[block], max_[block]) = bounds(nodes, first_[block], first_[block + 1]);
+        }
+        if (remap.renumbers()) {
+            rebalance(nodes);
+        }
+    }
+
+    // id, or the first entry of the next block after it that can hold entries in range, at most last
+    node_id skip(node_id id, node_id last, const time_range &range) const
+    {
+        if (range.unbounded()) {
+            return id;
+        }
+        for (size_t block = block_of(id); id < last && range.excludes(min_[block], max_[block]); block++) {
+            id = std::min(last, first_[block + 1]);
+        }
+        return id;
+    }
+
+    // first entry after the block holding id
+    node_id block_end(node_id id) const { return first_[block_of(id) + 1]; }
+
+    size_t memory_usage() const { return first_.heap_bytes() + min_.heap_bytes() + max_.heap_bytes(); }
+
+    void save(snapshot_writer &writer) const
+    {
+        writer.add("times.first", first_);
+        writer.add("times.min", min_);
+        writer.add("times.max", max_);
+    }
+
+    void load(const snapshot_reader &reader)
+    {
+        reader.load("times.first", first_);
+        reader.load("times.min", min_);
+        reader.load("times.max", max_);
+        if (min_.size() != max_.size() || first_.size() != min_.size() + 1) {
+            throw std::runtime_error("snapshot time columns are inconsistent");
+        }
+    }
+};
+
+// order of nodes_by_atime: most recently accessed first, entries without access time last, equal times
+// in entry order
+inline bool newer_first(const node_store &nodes, node_id id1, node_id id2)
+{
+    const int64_t t1 = nodes[id1].atime(), t2 = nodes[id2].atime();
+    return t1 != t2 ? t1 > t2 : node_store::entry_less(nodes, id1, nodes, id2);
+}
@@ -0,0 +1,136 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include "node_store.h"
+#include "murmur3.h"
+#include "thread_pool.h"
+
+struct tree_level_stats
+{
+    size_t depth;
+    size_t nodes;
+    double seconds;
+};
+
+// subtree data of one entry from its children, which have to be done already
+inline void hash_entry(node_store &nodes, node_id id, std::string &key)
+{
+    const auto n = nodes[id];
+    hash128 children;
+    uint64_t cum_kilobyte = n.kilobyte();
+    uint64_t file_count = n.filetype() == 'd' ? 0 : 1;
+    for (node_id child : nodes.children(id)) {
+        const auto c = nodes[child];
+        children += c.my_hash();
+        cum_kilobyte += c.cum_kilobyte();
+        file_count += c.file_count();
+    }
+    const uint64_t kilobyte = n.kilobyte();
+    const char type = n.filetype();
+    key.assign(n.basename());
+    key.append(reinterpret_cast<const char *>(&kilobyte), sizeof(kilobyte));
+    key.append(&type, 1);
+    key.append(reinterpret_cast<const char *>(&children), sizeof(children));
+    nodes.set_hash(id, murmur3_128(key.data(), key.size()));
+    nodes.set_cum_kilobyte(id, cum_kilobyte);
+    nodes.set_file_count(id, file_count);
+}
+
+// Merkle hash of every subtree, together with its cumulative size and file count.
+//
+// A subtree hash covers the entry itself (basename, size, type) and the sum of its children's hashes.
+// The sum makes the result independent of the order of children without letting identical siblings
+// cancel out, as xor would. Levels are processed deepest first so every child is done before its
+// parent, the nodes of one level are hashed in parallel. Requires link_children().
+inline std::vector<tree_level_stats> hash_tree(node_store &nodes, thread_pool &pool = default_pool())
+{
+    // breadth first order, level_begin[d] is where depth d starts
+    std::vector<node_id> order;
+    std::vector<size_t> level_begin;
+    order.reserve(nodes.size());
+    order.insert(order.end(), nodes.roots().begin(), nodes.roots().end());
+    for (size_t begin = 0; begin < order.size();) {
+        level_begin.push_back(begin);
+        const size_t end = order.size();
+        for (size_t i = begin; i < end; i++) {
+            const auto children = nodes.children(order[i]);
+            order.insert(order.end(), children.begin(), children.end());
+        }
+        begin = end;
+    }
+    level_begin.push_back(order.size());
+
+    std::vector<tree_level_stats> stats;
+    const size_t chunk = 4096;
+    nodes.detach_subtree_data();
+    for (size_t depth = level_begin.size() - 1; depth-- > 0;) {
+        const auto start = std::chrono::steady_clock::now();
+        const size_t begin = level_begin[depth], end = level_begin[depth + 1];
+        parallel_for(pool, (end - begin + chunk - 1) / chunk, [&](size_t c) {
+            std::string key;
+            for (size_t i = begin + c * chunk; i < std::min(end, begin + (c + 1) * chunk); i++) {
+                hash_entry(nodes, order[i], key);
+            }
+        });
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        stats.push_back({depth, end - begin, elapsed.count()});
+    }
+    return stats;
+}
+
+// Recomputes the subtree data of the given entries and of all their ancestors, after a hashed tree changed
+// in a few places. Work is proportional to the number of entries on those paths; as in hash_tree() they
+// are processed deepest first, one level at a time. Returns the entries hashed again, ascending.
+inline std::vector<node_id> rehash_paths(node_store &nodes, const std::vector<node_id> &changed,
+                                         thread_pool &pool = default_pool())
+{
+    if (changed.empty()) {
+        return {};
+    }
+    std::vector<char> dirty(nodes.size(), 0);
+    std::vector<node_id> hashed;
+    for (node_id id : changed) {
+        for (node_id n = id; n != no_node && !dirty[n]; n = nodes.parent_node(n)) {
+            dirty[n] = 1;
+            hashed.push_back(n);
+        }
+    }
+    std::sort(hashed.begin(), hashed.end());
+    std::vector<std::pair<size_t, node_id>> paths; // (depth, entry)
+    for (node_id id : hashed) {
+        paths.emplace_back(0, id);
+        for (node_id n = nodes.parent_node(id); n != no_node; n = nodes.parent_node(n)) {
+            paths.back().first++;
+        }
+    }
+    std::sort(paths.begin(), paths.end(), std::greater<>());
+
+    const size_t chunk = 4096;
+    if (!paths.empty()) {
+        nodes.detach_subtree_data();
+    }
+    for (size_t begin = 0, end; begin < paths.size(); begin = end) {
+        end = begin;
+        while (end < paths.size() && paths[end].first == paths[begin].first) {
+            end++;
+        }
+        parallel_for(pool, (end - begin + chunk - 1) / chunk, [&](size_t c) {
+            std::string key;
+            for (size_t i = begin + c * chunk; i < std::min(end, begin + (c + 1) * chunk); i++) {
+                hash_entry(nodes, paths[i].second, key);
+            }
+        });
+    }
+    return hashed;
+}
@@ -0,0 +1,206 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string_view>
+#include <algorithm>
+#include <cstdint>
+
+#include "column.h"
+#include "snapshot.h"
+#include "node_store.h"
+#include "basename_dictionary.h"
+
+// Substring index over basenames. Only distinct basenames are indexed: posting lists hold run numbers of
+// the basename_dictionary in ascending order.
+class trigram_index
+{
+private:
+    column<uint32_t> keys_;     // distinct trigrams, ascending
+    column<uint64_t> offsets_;  // postings of keys_[i] are postings_[offsets_[i] .. offsets_[i + 1]>
+    column<uint32_t> postings_;
+
+    static uint32_t trigram(const char *p)
+    {
+        return uint32_t(uint8_t(p[0])) << 16 | uint32_t(uint8_t(p[1])) << 8 | uint8_t(p[2]);
+    }
+
+    static void trigrams(std::string_view s, std::vector<uint32_t> &out)
+    {
+        out.clear();
+        for (size_t i = 0; i + 3 <= s.size(); i++) {
+            out.push_back(trigram(s.data() + i));
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    // first position >= pos in list holding a value >= value, galloping since lists are mostly far apart
+    static const uint32_t *seek(const uint32_t *pos, const uint32_t *end, uint32_t value)
+    {
+        size_t step = 1;
+        while (step < static_cast<size_t>(end - pos) && pos[step] < value) {
+            pos += step;
+            step *= 2;
+        }
+        return std::lower_bound(pos, pos + std::min(step + 1, static_cast<size_t>(end - pos)), value);
+    }
+
+public:
+    void build(const node_store &nodes, const basename_dictionary &dictionary)
+    {
+        // count postings per trigram first, so they can be written in place in a second pass
+        std::vector<uint32_t> counts(1 << 24, 0);
+        std::vector<uint32_t> grams;
+        for (size_t run = 0; run < dictionary.size(); run++) {
+            trigrams(dictionary.name(nodes, run), grams);
+            for (uint32_t gram : grams) {
+                counts[gram]++;
+            }
+        }
+        keys_.clear();
+        offsets_.clear();
+        uint64_t total = 0;
+        for (uint32_t gram = 0; gram < counts.size(); gram++) {
+            if (counts[gram]) {
+                keys_.push_back(gram);
+                offsets_.push_back(total);
+                total += counts[gram];
+                counts[gram] = static_cast<uint32_t>(keys_.size() - 1); // from now on: index into keys_
+            }
+        }
+        offsets_.push_back(total);
+        std::vector<uint64_t> fill(offsets_.begin(), offsets_.end() - 1);
+        postings_.assign(total, 0);
+        for (size_t run = 0; run < dictionary.size(); run++) {
+            trigrams(dictionary.name(nodes, run), grams);
+            for (uint32_t gram : grams) {
+                postings_[fill[counts[gram]]++] = static_cast<uint32_t>(run);
+            }
+        }
+    }
+
+    // Brings the index up to date after the dictionary changed: run_remap holds the new run number of every
+    // old run (npos if its basename is gone), added_runs the ascending new runs that did not exist before.
+    // Both keep basename order, so remapped posting lists stay sorted and only added runs are tokenized.
+    void update(const node_store &nodes, const basename_dictionary &dictionary, const std::vector<size_t> &run_remap,
+                const std::vector<size_t> &added_runs)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> added; // (trigram, run)
+        std::vector<uint32_t> grams;
+        for (size_t run : added_runs) {
+            trigrams(dictionary.name(nodes, run), grams);
+            for (uint32_t gram : grams) {
+                added.emplace_back(gram, static_cast<uint32_t>(run));
+            }
+        }
+        std::sort(added.begin(), added.end());
+
+        column<uint32_t> keys, postings;
+        column<uint64_t> offsets;
+        keys.reserve(keys_.size());
+        postings.reserve(postings_.size() + added.size());
+        std::vector<uint32_t> old_list;
+        size_t key = 0, next = 0;
+        while (key < keys_.size() || next < added.size()) {
+            const uint32_t gram = next == added.size() || (key < keys_.size() && keys_[key] < added[next].first)
+                                      ? keys_[key]
+                                      : added[next].first;
+            old_list.clear();
+            if (key < keys_.size() && keys_[key] == gram) {
+                for (uint64_t i = offsets_[key]; i < offsets_[key + 1]; i++) {
+                    if (run_remap[postings_[i]] != basename_dictionary::npos) {
+                        old_list.push_back(static_cast<uint32_t>(run_remap[postings_[i]]));
+                    }
+                }
+                key++;
+            }
+            const size_t begin = postings.size();
+            auto old_run = old_list.begin();
+            for (; next < added.size() && added[next].first == gram; next++) {
+                for (; old_run != old_list.end() && *old_run < added[next].second; old_run++) {
+                    postings.push_back(*old_run);
+                }
+                postings.push_back(added[next].second);
+            }
+            postings.append(old_run, old_list.end());
+            if (postings.size() > begin) {
+                keys.push_back(gram);
+                offsets.push_back(begin);
+            }
+        }
+        offsets.push_back(postings.size());
+        keys_.swap(keys);
+        offsets_.swap(offsets);
+        postings_.swap(postings);
+    }
+
+    // visits the node range [first, last> of every basename containing term, in basename order, until
+    // visit returns false. term must be at least three characters long.
+    template <typename F>
+    void find(const node_store &nodes, const basename_dictionary &dictionary, std::string_view term, F visit) const
+    {
+        std::vector<uint32_t> grams;
+        trigrams(term, grams);
+        std::vector<std::pair<const uint32_t *, const uint32_t *>> lists;
+        for (uint32_t gram : grams) {
+            auto key = std::lower_bound(keys_.begin(), keys_.end(), gram);
+            if (key == keys_.end() || *key != gram) {
+                return; // some trigram never occurs
+            }
+            const size_t i = static_cast<size_t>(key - keys_.begin());
+            lists.emplace_back(postings_.data() + offsets_[i], postings_.data() + offsets_[i + 1]);
+        }
+        if (lists.empty()) {
+            return;
+        }
+        std::sort(lists.begin(), lists.end(), [](const auto &lhs, const auto &rhs) {
+            return lhs.second - lhs.first < rhs.second - rhs.first;
+        });
+        // drive the intersection from the shortest list, the others are only probed
+        for (const uint32_t *candidate = lists[0].first; candidate != lists[0].second; candidate++) {
+            bool all = true;
+            for (size_t i = 1; i < lists.size() && all; i++) {
+                lists[i].first = seek(lists[i].first, lists[i].second, *candidate);
+                all = lists[i].first != lists[i].second && *lists[i].first == *candidate;
+            }
+            if (!all) {
+                continue;
+            }
+            if (dictionary.name(nodes, *candidate).find(term) == std::string_view::npos) {
+                continue; // trigrams occur, but not adjacent
+            }
+            if (!visit(dictionary.first(*candidate), dictionary.last(*candidate))) {
+                return;
+            }
+        }
+    }
+
+    size_t num_postings() const { return postings_.size(); }
+
+    size_t memory_usage() const
+    {
+        return keys_.heap_bytes() + offsets_.heap_bytes() + postings_.heap_bytes();
+    }
+
+    void save(snapshot_writer &writer) const
+    {
+        writer.add("trigrams.keys", keys_);
+        writer.add("trigrams.offsets", offsets_);
+        writer.add("trigrams.postings", postings_);
+    }
+
+    void load(const snapshot_reader &reader)
+    {
+        reader.load("trigrams.keys", keys_);
+        reader.load("trigrams.offsets", offsets_);
+        reader.load("trigrams.postings", postings_);
+        if (offsets_.size() != keys_.size() + 1) {
+            throw std::runtime_error("snapshot trigram columns are inconsistent");
+        }
+    }
+};
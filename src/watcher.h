@@ -0,0 +1,174 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+// Directories that changed since the previous batch. Created directories were not watched before, so
+// they have to be crawled as a whole; changed ones only need to be listed again.
+struct watch_batch
+{
+    std::vector<std::string> changed;
+    std::vector<std::string> created;
+    bool overflow = false; // events were lost, everything has to be listed again
+    bool stopped = false;
+};
+
+// Collects inotify events of watched directories and hands them out in batches. inotify watches single
+// directories, so every directory of a tree is watched on its own (see /proc/sys/fs/inotify/max_user_watches).
+// fanotify could watch whole file systems, but needs CAP_SYS_ADMIN.
+class watcher
+{
+private:
+    int fd_ = -1;
+    int wakeup_ = -1;
+    std::mutex mutex_;
+    std::unordered_map<int, std::string> paths_; // watch descriptor -> directory
+    bool full_ = false;
+
+    static constexpr uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB |
+                                     IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+    // polls until events arrive or the timeout passes, false once stop() was called
+    bool wait_readable(int timeout_ms)
+    {
+        pollfd fds[2] = {{fd_, POLLIN, 0}, {wakeup_, POLLIN, 0}};
+        while (::poll(fds, 2, timeout_ms) == -1) {
+            if (errno != EINTR) {
+                throw std::runtime_error(std::string("poll: ") + strerror(errno));
+            }
+        }
+        return !(fds[1].revents & POLLIN);
+    }
+
+    void read_events(watch_batch &batch)
+    {
+        alignas(inotify_event) char buffer[64 * 1024];
+        const ssize_t n = ::read(fd_, buffer, sizeof(buffer));
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (ssize_t pos = 0; pos < n;) {
+            const auto *event = reinterpret_cast<const inotify_event *>(buffer + pos);
+            pos += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                batch.overflow = true;
+                continue;
+            }
+            const auto iter = paths_.find(event->wd);
+            if (iter == paths_.end()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                paths_.erase(iter);
+                continue;
+            }
+            if (event->mask & IN_MOVE_SELF) {
+                // the path is wrong from now on, its new location is watched again if it is indexed
+                ::inotify_rm_watch(fd_, event->wd);
+                paths_.erase(iter);
+                continue;
+            }
+            if (event->mask & IN_DELETE_SELF) {
+                continue; // the parent reports the deletion
+            }
+            batch.changed.push_back(iter->second);
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                batch.created.push_back(iter->second + '/' + event->name);
+            }
+        }
+    }
+
+public:
+    watcher()
+    {
+        fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        wakeup_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd_ == -1 || wakeup_ == -1) {
+            throw std::runtime_error(std::string("cannot watch for changes: ") + strerror(errno));
+        }
+    }
+
+    ~watcher()
+    {
+        ::close(fd_);
+        ::close(wakeup_);
+    }
+
+    watcher(const watcher &) = delete;
+    watcher &operator=(const watcher &) = delete;
+
+    // false if the directory cannot be watched, e.g. because the limit on watches was reached
+    bool watch(const std::string &dir)
+    {
+        const int wd = ::inotify_add_watch(fd_, dir.empty() ? "/" : dir.c_str(), mask);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (wd == -1) {
+            full_ = full_ || errno == ENOSPC;
+            return false;
+        }
+        paths_[wd] = dir;
+        return true;
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return paths_.size();
+    }
+
+    // true once a watch was refused because max_user_watches was reached
+    bool full()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return full_;
+    }
+
+    // Blocks until something changed, then keeps collecting events for delay so bursts (an unpacked
+    // archive, a build) end up in one batch. Directories are reported once, in sorted order.
+    watch_batch wait(std::chrono::milliseconds delay)
+    {
+        watch_batch batch;
+        if (!wait_readable(-1)) {
+            batch.stopped = true;
+            return batch;
+        }
+        const auto until = std::chrono::steady_clock::now() + delay;
+        for (auto now = std::chrono::steady_clock::now(); now < until; now = std::chrono::steady_clock::now()) {
+            read_events(batch);
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count();
+            if (!wait_readable(static_cast<int>(std::max<long long>(left, 1)))) {
+                batch.stopped = true;
+                return batch;
+            }
+        }
+        read_events(batch);
+        for (auto *dirs : {&batch.changed, &batch.created}) {
+            std::sort(dirs->begin(), dirs->end());
+            dirs->erase(std::unique(dirs->begin(), dirs->end()), dirs->end());
+        }
+        return batch;
+    }
+
+    // wakes up wait() from another thread
+    void stop()
+    {
+        const uint64_t one = 1;
+        const ssize_t written = ::write(wakeup_, &one, sizeof(one));
+        (void)written; // only fails when the counter would overflow
+    }
+};
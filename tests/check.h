@@ -0,0 +1,34 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <iostream>
+
+// Minimal checks for the test programs: a failed CHECK reports itself and the test exits non-zero at the
+// end, so one run shows every failure.
+
+inline int &check_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                                     \
+    do {                                                                                                     \
+        if (!(condition)) {                                                                                  \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": check failed: " #condition << std::endl;          \
+            check_failures()++;                                                                              \
+        }                                                                                                    \
+    } while (0)
+
+inline int check_result()
+{
+    if (check_failures() > 0) {
+        std::cerr << check_failures() << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <string>
+#include <fstream>
+#include <thread>
+#include <cstdio>
+#include <unistd.h>
+
+#include "crow.h"
+#include "shard_set.h"
+#include "routes.h"
+#include "check.h"
+
+using namespace std;
+
+// /find paging over two shards that have two entries named foo each
+
+static string write_index(const string &filename, const string &root)
+{
+    ofstream out(filename);
+    out << "4\t1\t2020-01-01+00:00:00.0000000000\td\t" << root << "\n"
+        << "4\t2\t2020-01-01+00:00:00.0000000000\td\t" << root << "/x\n"
+        << "4\t3\t2020-01-01+00:00:00.0000000000\td\t" << root << "/y\n"
+        << "8\t4\t2020-01-02+00:00:00.0000000000\tf\t" << root << "/x/foo\n"
+        << "8\t5\t2020-01-03+00:00:00.0000000000\tf\t" << root << "/y/foo\n"
+        << "8\t6\t2020-01-04+00:00:00.0000000000\tf\t" << root << "/y/bar\n";
+    std::remove((filename + ".snapshot").c_str());
+    return filename;
+}
+
+static crow::response find(crow::App<> &app, const string &url, const string &body)
+{
+    crow::request req;
+    req.method = "POST"_method;
+    req.raw_url = url;
+    req.url = "/find";
+    req.url_params = crow::query_string(url);
+    req.body = body;
+    crow::response res;
+    app.handle(req, res);
+    return res;
+}
+
+static size_t count_rows(const string &json)
+{
+    size_t rows = 0;
+    for (size_t pos = 0; (pos = json.find("\"file\":", pos)) != string::npos; pos++) {
+        rows++;
+    }
+    return rows;
+}
+
+// the url in "next", empty on the last page
+static string next_url(const string &json)
+{
+    const size_t start = json.find("\"next\":\"");
+    return start == string::npos ? "" : json.substr(start + 8, json.find('"', start + 8) - start - 8);
+}
+
+int main()
+{
+    const string dir = "/tmp/indexer_test_find." + to_string(getpid());
+    shard_set shards;
+    shards.add(write_index(dir + ".a.txt", "/a"), "a");
+    shards.add(write_index(dir + ".b.txt", "/b"), "b");
+    shards.run();
+
+    query_sessions sessions(chrono::milliseconds(60 * 1000));
+    query_executor executor(2);
+    add_route_limits(executor);
+    const auto index_html = static_asset::load("index.html", "text/html; charset=utf-8");
+    crow::App<> app;
+    add_routes(app, shards, sessions, executor, index_html);
+    app.validate();
+
+    // a page of no results, there is nothing to continue after
+    auto res = find(app, "/find?format=json", "foo\n0");
+    CHECK(res.code == 200);
+    CHECK(count_rows(res.body) == 0);
+    CHECK(next_url(res.body).empty());
+
+    // the first page holds the entries of shard a exactly, the next one continues in shard b
+    res = find(app, "/find?format=json", "foo\n2");
+    CHECK(res.code == 200);
+    CHECK(count_rows(res.body) == 2);
+    CHECK(res.body.find("/a/x/foo") != string::npos && res.body.find("/a/y/foo") != string::npos);
+    const string next = next_url(res.body);
+    CHECK(!next.empty());
+    res = find(app, next, "foo\n2");
+    CHECK(res.code == 200);
+    CHECK(count_rows(res.body) == 2);
+    CHECK(res.body.find("/b/x/foo") != string::npos && res.body.find("/b/y/foo") != string::npos);
+    CHECK(next_url(res.body).empty());
+
+    // all of them on one page
+    res = find(app, "/find?format=json", "foo\n4");
+    CHECK(count_rows(res.body) == 4);
+    CHECK(next_url(res.body).empty());
+
+    for (const char *shard : {".a.txt", ".b.txt"}) {
+        std::remove((dir + shard).c_str());
+        std::remove((dir + shard + ".snapshot").c_str());
+        std::remove((dir + shard + ".hashes").c_str());
+    }
+    return check_result();
+}
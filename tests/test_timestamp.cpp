@@ -0,0 +1,62 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <string>
+
+#include "node_store.h"
+#include "check.h"
+
+using namespace std;
+
+// parse_timestamp() on what find prints, and on what it must not take for a timestamp
+
+int main()
+{
+    // find's %A+, round-tripping through format_timestamp()
+    const string printed = "2019-02-20+01:38:12.1234567890";
+    CHECK(parse_timestamp(printed) != no_timestamp);
+    CHECK(format_timestamp(parse_timestamp(printed)) == printed);
+    CHECK(parse_timestamp("1970-01-01+00:00:00.0000000000") == 0);
+    CHECK(parse_timestamp("1970-01-01+00:00:01") == 1000000000);
+    CHECK(parse_timestamp("2019-02-20+01:38:12.5") == parse_timestamp("2019-02-20+01:38:12") + 500000000);
+    CHECK(parse_timestamp("2020-02-29+23:59:59") != no_timestamp);
+    CHECK(parse_timestamp("2000-02-29+00:00:00") != no_timestamp);
+    CHECK(parse_timestamp("2016-12-31+23:59:60") != no_timestamp);
+
+    for (const char *malformed : {
+             "",
+             "2019",
+             "2019-02-20",
+             "2019-02-20+01:38",
+             "2019/02/20+01:38:12",
+             "2019-02-20 01:38:12",
+             "2019-02-20T01:38:12",
+             "2019-02-20+01-38-12",
+             "2019-02-20+01:38:12,123",
+             "2019-02-20+01:38:12.",
+             "2019-02-20+01:38:12.12x",
+             "2019-02-20+01:38:12x",
+             "20190-2-20+01:38:12",
+             "-019-02-20+01:38:12",
+             "2019--1-20+01:38:12",
+             "2019-00-20+01:38:12",
+             "2019-13-20+01:38:12",
+             "2019-02-00+01:38:12",
+             "2019-04-31+01:38:12",
+             "2019-02-29+01:38:12",
+             "1900-02-29+01:38:12",
+             "2019-02-20+24:00:00",
+             "2019-02-20+01:60:00",
+             "2019-02-20+01:38:61",
+             "2019-02-20+-1:38:12",
+             "not-a-date+at:al:l!",
+         }) {
+        if (parse_timestamp(malformed) != no_timestamp) {
+            cerr << "taken for a timestamp: \"" << malformed << '"' << endl;
+            check_failures()++;
+        }
+    }
+    return check_result();
+}
@@ -0,0 +1,279 @@
+/*
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this
+file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+#include "shard_set.h"
+#include "check.h"
+
+using namespace std;
+
+// index_version::update() against an index built from scratch from the same listing
+
+struct entry
+{
+    size_t kilobyte;
+    uint64_t inode;
+    int64_t atime;
+    char filetype;
+    string file;
+};
+
+static const int64_t day = int64_t(86400) * 1000000000;
+static uint64_t next_inode = 1;
+
+static void add(vector<entry> &entries, size_t kilobyte, int64_t atime, char filetype, const string &file)
+{
+    entries.push_back({kilobyte, next_inode++, atime, filetype, file});
+}
+
+// a few thousand entries, over more than one time block, with directories s0..s9 of t0 and t1 alike
+static vector<entry> tree()
+{
+    vector<entry> entries;
+    add(entries, 4, 0, 'd', "/r");
+    for (int t = 0; t < 3; t++) {
+        const string top = "/r/t" + to_string(t);
+        add(entries, 4, day, 'd', top);
+        for (int s = 0; s < 40; s++) {
+            const string dir = top + "/s" + to_string(s);
+            add(entries, 4, 2 * day, 'd', dir);
+            for (int f = 0; f < 55; f++) {
+                const bool alike = t < 2 && s < 10;
+                const size_t kilobyte = alike ? 1 + s * 7 + f : 1 + t * 1000 + s * 7 + f;
+                const int64_t atime = (10 + (t * 40 + s) * 55 + f) * day / 100;
+                add(entries, kilobyte, atime, 'f', dir + "/f" + to_string(f) + (f % 3 ? ".txt" : ".c"));
+            }
+        }
+    }
+    return entries;
+}
+
+static entry *find_file(vector<entry> &entries, const string &file)
+{
+    for (auto &e : entries) {
+        if (e.file == file) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+static void remove_below(vector<entry> &entries, const string &dir)
+{
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const entry &e) {
+                      return e.file == dir || e.file.compare(0, dir.size() + 1, dir + "/") == 0;
+                  }),
+                  entries.end());
+}
+
+static string filename_of(const string &name)
+{
+    return "/tmp/indexer_test_update." + to_string(getpid()) + "." + name + ".txt";
+}
+
+static shared_ptr<const index_version> build(const vector<entry> &entries, const string &name)
+{
+    const string filename = filename_of(name);
+    {
+        ofstream out(filename);
+        for (const auto &e : entries) {
+            out << e.kilobyte << '\t' << e.inode << '\t' << format_timestamp(e.atime) << '\t' << e.filetype << '\t'
+                << e.file << '\n';
+        }
+    }
+    std::remove((filename + ".snapshot").c_str());
+    shard_set shards;
+    shards.add(filename, name);
+    shards.run();
+    auto index = shards.current()[0];
+    std::remove(filename.c_str());
+    std::remove((filename + ".snapshot").c_str());
+    return index;
+}
+
+// index patched with a listing of entries, of everything or of the directories in dirs
+static index_version patched(const index_version &index, const vector<entry> &entries,
+                             const vector<string> *dirs = nullptr)
+{
+    node_store fresh;
+    for (const auto &e : entries) {
+        string_view dir, name;
+        split_path(e.file, dir, name);
+        if (!dirs || std::find(dirs->begin(), dirs->end(), string(dir)) != dirs->end()) {
+            fresh.add(e.kilobyte, e.inode, e.atime, e.filetype, e.file);
+        }
+    }
+    index_version next = index;
+    next.update(std::move(fresh), dirs);
+    return next;
+}
+
+template <typename Range>
+static vector<node_id> ids(const Range &range)
+{
+    return vector<node_id>(range.begin(), range.end());
+}
+
+static void check_same(const index_version &updated, const index_version &built, const string &what)
+{
+    const int failures = check_failures();
+    const auto &a = updated.nodes, &b = built.nodes;
+    CHECK(a.size() == b.size());
+    CHECK(a.names() == b.names());
+    CHECK(ids(a.roots()) == ids(b.roots()));
+    bool entries = a.size() == b.size(), subtrees = entries, links = entries;
+    for (node_id id = 0; id < a.size() && id < b.size(); id++) {
+        entries = entries && a[id].file() == b[id].file() && a[id].kilobyte() == b[id].kilobyte() &&
+                  a[id].inode() == b[id].inode() && a[id].filetype() == b[id].filetype() &&
+                  a[id].atime() == b[id].atime() && a.name_offset(id) == b.name_offset(id);
+        subtrees = subtrees && a[id].my_hash() == b[id].my_hash() && a[id].cum_kilobyte() == b[id].cum_kilobyte() &&
+                   a[id].file_count() == b[id].file_count();
+        links = links && a.parent_node(id) == b.parent_node(id) && ids(a.children(id)) == ids(b.children(id));
+    }
+    CHECK(entries);
+    CHECK(subtrees);
+    CHECK(links);
+
+    CHECK(updated.basenames.size() == built.basenames.size());
+    bool runs = updated.basenames.size() == built.basenames.size();
+    for (size_t run = 0; runs && run < built.basenames.size(); run++) {
+        runs = updated.basenames.first(run) == built.basenames.first(run) &&
+               updated.basenames.last(run) == built.basenames.last(run) &&
+               updated.extensions.name(updated.extensions.of_run(run)) ==
+                   built.extensions.name(built.extensions.of_run(run));
+    }
+    CHECK(runs);
+
+    CHECK(ids(updated.nodes_by_size) == ids(built.nodes_by_size));
+    CHECK(ids(updated.nodes_by_atime) == ids(built.nodes_by_atime));
+
+    CHECK(updated.trigrams.num_postings() == built.trigrams.num_postings());
+    for (const char *term : {"txt", "f12", "f5.c", "new", "zzz"}) {
+        vector<pair<node_id, node_id>> found[2];
+        updated.trigrams.find(a, updated.basenames, term, [&](node_id first, node_id last) {
+            found[0].emplace_back(first, last);
+            return true;
+        });
+        built.trigrams.find(b, built.basenames, term, [&](node_id first, node_id last) {
+            found[1].emplace_back(first, last);
+            return true;
+        });
+        CHECK(found[0] == found[1]);
+    }
+
+    CHECK(updated.dupes.size() == built.dupes.size());
+    bool groups = updated.dupes.size() == built.dupes.size();
+    for (size_t group = 0; groups && group < built.dupes.size(); group++) {
+        groups = updated.dupes.hash(group) == built.dupes.hash(group) &&
+                 updated.dupes.cum_kilobyte(group) == built.dupes.cum_kilobyte(group) &&
+                 ids(updated.dupes.members(group)) == ids(built.dupes.members(group));
+    }
+    CHECK(groups);
+    CHECK(ids(updated.dupes.by_hash()) == ids(built.dupes.by_hash()));
+
+    // time blocks may differ from the ones of a build, but never skip an entry in range
+    bool times = true;
+    for (node_id id = 0; id < a.size(); id++) {
+        time_range range;
+        range.after = a[id].atime();
+        range.before = a[id].atime() + 1;
+        times = times && updated.times.skip(id, static_cast<node_id>(a.size()), range) == id;
+    }
+    for (node_id id = 0; id < a.size(); id = updated.times.block_end(id)) {
+        times = times && updated.times.block_end(id) > id &&
+                updated.times.block_end(id) - id <= 2 * time_index::block_size;
+    }
+    CHECK(times);
+    if (check_failures() != failures) {
+        cerr << "  after " << what << endl;
+    }
+}
+
+int main()
+{
+    auto entries = tree();
+    const auto base = build(entries, "base");
+    CHECK(base->dupes.size() == 10);
+
+    // modified only: ids stay what they are
+    {
+        auto changed = entries;
+        find_file(changed, "/r/t2/s3/f4.txt")->kilobyte = 5000;
+        find_file(changed, "/r/t0/s20/f0.c")->kilobyte = 1;
+        for (int s = 0; s < 40; s += 3) {
+            find_file(changed, "/r/t1/s" + to_string(s) + "/f7.txt")->atime = 3 * day + s;
+        }
+        check_same(patched(*base, changed), *build(changed, "modified"), "modify-only");
+    }
+
+    // inserted: new names, a new extension and a new directory, also in front of the first entry
+    auto grown = entries;
+    {
+        add(grown, 3, day, 'f', "/r/t0/s1/new.zzz");
+        add(grown, 3, day, 'f', "/r/t2/s39/f3.txt2");
+        add(grown, 4, day, 'd', "/r/t2/new");
+        for (int f = 0; f < 5000; f++) {
+            add(grown, 1 + f % 17, (f % 50) * day / 7, 'f', "/r/t2/new/f" + to_string(f) + ".txt");
+        }
+        add(grown, 5, day, 'f', "/r/t1/s0/0first");
+        check_same(patched(*base, grown), *build(grown, "inserted"), "insert");
+    }
+
+    // deleted: a directory with everything below it, and single files
+    auto shrunk = entries;
+    {
+        remove_below(shrunk, "/r/t2/s5");
+        remove_below(shrunk, "/r/t0/s11/f9.txt");
+        remove_below(shrunk, "/r/t1/s3/f0.c");
+        check_same(patched(*base, shrunk), *build(shrunk, "deleted"), "delete-with-subtree");
+    }
+
+    // hashed again: s3 of t1 no longer like the one of t0, s12 of t1 now like the one of t0
+    {
+        auto rehashed = entries;
+        find_file(rehashed, "/r/t1/s3/f1.txt")->kilobyte = 777;
+        for (int f = 0; f < 55; f++) {
+            find_file(rehashed, "/r/t1/s12/f" + to_string(f) + (f % 3 ? ".txt" : ".c"))->kilobyte = 1 + 12 * 7 + f;
+            find_file(rehashed, "/r/t0/s12/f" + to_string(f) + (f % 3 ? ".txt" : ".c"))->kilobyte = 1 + 12 * 7 + f;
+        }
+        remove_below(rehashed, "/r/t0/s7/f2.txt");
+        add(rehashed, 1, day, 'f', "/r/t0/s8/extra.txt");
+        const auto updated = patched(*base, rehashed);
+        const auto built = build(rehashed, "rehashed");
+        CHECK(built->dupes.size() == 8);
+        check_same(updated, *built, "rehash");
+    }
+
+    // a directory that is replaced (another inode) keeps its children, one listing of just one directory,
+    // and updates on top of updates
+    {
+        auto replaced = grown;
+        for (auto &e : replaced) {
+            if (e.file == "/r/t0/s2") {
+                e.inode = next_inode++;
+            }
+        }
+        const auto first = patched(*base, replaced);
+        check_same(first, *build(replaced, "replaced"), "replaced directory");
+
+        find_file(replaced, "/r/t1/s4/f3.c")->kilobyte = 4242;
+        remove_below(replaced, "/r/t1/s4/f5.txt");
+        add(replaced, 2, 5 * day, 'f', "/r/t1/s4/late.txt");
+        const vector<string> dirs{"/r/t1/s4"};
+        const auto second = patched(first, replaced, &dirs);
+        check_same(second, *build(replaced, "listed"), "listed directory");
+
+        remove_below(replaced, "/r/t2/new");
+        remove_below(replaced, "/r/t0");
+        check_same(patched(second, replaced), *build(replaced, "shrunk"), "update of an update");
+    }
+    return check_result();
+}